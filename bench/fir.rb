@@ -0,0 +1,27 @@
+# FIR block throughput, direct form against FFT overlap-save, per filter
+# length. the first length where FFT wins is the default for
+# FIR.fft_threshold.
+#
+#   ruby -Ilib bench/fir.rb [block size]
+
+require 'radspberry/core'
+
+BLOCK = (ARGV[0] || 4096).to_i
+INPUT = Array.new( BLOCK ){ DSP.noise }
+
+def rate taps, threshold
+  DSP::FIR.fft_threshold = threshold
+  fir = DSP::FIR.new( Array.new( taps ){ DSP.noise } )
+  runs = [2, 20_000 / taps].max
+  t = Process.clock_gettime( Process::CLOCK_MONOTONIC )
+  runs.times{ fir.ticks( INPUT ) }
+  runs * BLOCK / (Process.clock_gettime( Process::CLOCK_MONOTONIC ) - t)
+end
+
+crossover = nil
+[16, 32, 64, 96, 128, 192, 256, 384, 512, 1024, 2048].each do |taps|
+  direct, fft = rate( taps, Float::INFINITY ), rate( taps, 0 )
+  crossover ||= taps if fft > direct
+  puts "%5d taps  direct %9.0f  fft %9.0f samples/s  (%5.1fx realtime at 44.1k)" % [ taps, direct, fft, [direct, fft].max / 44100 ]
+end
+puts "fft wins from #{crossover} taps"
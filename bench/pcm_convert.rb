@@ -0,0 +1,32 @@
+# float -> 16/24 bit PCM throughput: the old per-sample path (round
+# through Floats, pack one sample at a time for 24 bit) against a
+# Quantizer block pass, with and without dither and noise shaping.
+#
+#   ruby -Ilib bench/pcm_convert.rb [seconds of audio]
+
+require 'radspberry/core'
+
+SECONDS = (ARGV[0] || 10).to_f
+BLOCK   = 2**12
+RATE    = 44100
+DATA    = Array.new( (SECONDS * RATE).to_i ){ |i| 0.9 * Math.sin( i * 0.01 ) }
+BLOCKS  = DATA.each_slice( BLOCK ).to_a
+
+def measure label
+  t = Process.clock_gettime( Process::CLOCK_MONOTONIC )
+  bytes = BLOCKS.inject( 0 ){ |n,block| n + yield( block ).bytesize }
+  dt = Process.clock_gettime( Process::CLOCK_MONOTONIC ) - t
+  puts "%-28s %8.2f Msamples/s  %6.1fx realtime  (%d bytes)" % [ label, DATA.size / dt / 1e6, SECONDS / dt, bytes ]
+end
+
+[16, 24].each do |bits|
+  scale = 2 ** (bits - 1) - 1
+  measure( "#{bits} bit, old path" ) do |block|
+    ints = block.map{ |d| (d * scale).round.to_f.to_i }
+    bits == 24 ? ints.map{ |s| [s].pack( "VX" ) }.join : ints.pack( "s<*" )
+  end
+  { "no dither" => { :dither => false }, "tpdf" => {}, "tpdf + shaping" => { :shape => true } }.each do |name, opts|
+    q = DSP::Quantizer.new( bits, opts )
+    measure( "#{bits} bit, #{name}" ){ |block| q.pack( block ) }
+  end
+end
@@ -0,0 +1,28 @@
+# file-to-file throughput of Pipeline: one file, then a batch spread
+# over all cores, through an Hpf -> ZDLP chain.
+#
+#   ruby -Ilib bench/pipeline.rb [seconds per file] [files]
+
+require 'radspberry/core'
+require 'tmpdir'
+
+SECONDS = (ARGV[0] || 30).to_f
+FILES   = (ARGV[1] || Etc.nprocessors).to_i
+
+Dir.mktmpdir do |dir|
+  frames = (SECONDS * 44100).to_i
+  inputs = FILES.times.map do |n|
+    path = File.join( dir, "in#{n}.wav" )
+    RiffFile.new( path, "wb+" ){ |wav| wav.write( 2, 44100, 16, [Array.new( 2 * frames ){ rand( -16384..16384 ) }] ) }
+    path
+  end
+  pipeline = Pipeline.new( :format => :pcm16 ){ DSP::ProcessorChain[ DSP::Hpf.new( 80 ), DSP::ZDLP.new( 8000 ) ] }
+
+  one = pipeline.run( inputs[0], File.join( dir, "one.wav" ) )
+  puts "1 file                 %6.1fx realtime" % one.realtime_factor
+
+  t = Process.clock_gettime( Process::CLOCK_MONOTONIC )
+  pipeline.run_all( inputs, File.join( dir, "out" ) )
+  dt = Process.clock_gettime( Process::CLOCK_MONOTONIC ) - t
+  puts "%d files, %d workers   %6.1fx realtime overall" % [ FILES, Etc.nprocessors, FILES * SECONDS / dt ]
+end
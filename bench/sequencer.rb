@@ -0,0 +1,31 @@
+# Sequencer scheduling and dispatch with many pending events: schedule N
+# parameter changes at random times over a minute, then render it in
+# 256 sample blocks against a silent synth, so the time is all heap.
+#
+#   ruby -Ilib bench/sequencer.rb [events]
+
+require 'radspberry/core'
+
+class Silence < DSP::Generator
+  param_accessor :level, :range => false
+  def ticks samples
+    Vector.zeros( samples )
+  end
+end
+
+EVENTS  = (ARGV[0] || 50_000).to_i
+SECONDS = 60
+BLOCK   = 256
+
+def measure label
+  t = Process.clock_gettime( Process::CLOCK_MONOTONIC )
+  yield
+  dt = Process.clock_gettime( Process::CLOCK_MONOTONIC ) - t
+  puts "%-28s %8.3f s  %8.2f us/event" % [ label, dt, dt / EVENTS * 1e6 ]
+end
+
+seq = DSP::Sequencer.new( Silence.new )
+measure( "schedule #{EVENTS}" ){ EVENTS.times{ seq.set( rand * SECONDS, "level", rand ) } }
+blocks = (SECONDS * DSP::Base.sampleRate / BLOCK).ceil
+measure( "render #{SECONDS}s, #{BLOCK} blocks" ){ blocks.times{ seq.ticks( BLOCK ) } }
+puts "%d events left pending" % seq.pending
@@ -0,0 +1,27 @@
+# startup time of the offline entry point vs. the full library.
+#
+#   ruby -Ilib bench/startup.rb [runs]
+#
+# each require runs in a fresh interpreter; reports the median wall time
+# and checks that no audio/MIDI driver (or REXML) got loaded on the way.
+
+require 'rbconfig'
+
+RUNS    = (ARGV[0] || 10).to_i
+LIB     = File.expand_path( '../../lib', __FILE__ )
+DRIVERS = /ffi-portaudio|portmidi|rexml/
+
+def time_require feature
+  script = "t=Process.clock_gettime(Process::CLOCK_MONOTONIC); require '#{feature}';" \
+           "puts Process.clock_gettime(Process::CLOCK_MONOTONIC)-t; puts $LOADED_FEATURES.grep(#{DRIVERS.inspect}).size"
+  times, drivers = RUNS.times.map do
+    out = IO.popen( [RbConfig.ruby, "-I#{LIB}", "-e", script], &:read ).split
+    [ out[0].to_f, out[1].to_i ]
+  end.transpose
+  [ times.sort[ times.size / 2 ], drivers.max ]
+end
+
+%w[ radspberry/core radspberry ].each do |feature|
+  median, drivers = time_require( feature )
+  puts "require %-18s %7.1f ms  (median of %d, %d driver files loaded)" % [ "'#{feature}'", median * 1e3, RUNS, drivers ]
+end
@@ -1,3 +1,6 @@
+# to render this to a file instead of playing it:
+#   ruby -Ilib -rradspberry -e 'DSP::VirtualTime.render_script "example.rb", "example.wav"'
+
 require 'radspberry'
 include DSP
 
@@ -16,14 +19,11 @@ sleep 1
 
 puts "starting crossfader (supersaw with rpmnoise)"
 chain = XFader[ o1=SuperSaw.new, o2=RpmNoise.new ]
-Speaker[ chain ]
 o1.spread  = 0.8
-chain.fade = 0
-sleep 5
-10.times do
-  chain.fade += 0.1
-  sleep 0.5
-end
+auto = Automation.new( chain )
+auto.lane "fade", [[0, 0.0], [5, 0.0], [10, 1.0]]
+Speaker[ auto ]
+sleep 10
 
 puts "muting"
 Speaker.mute
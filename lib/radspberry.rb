@@ -2,22 +2,11 @@ class Radspberry
   VERSION = '0.1.1'
 end
 
-require 'matrix'
+require 'radspberry/core'
 
-# require 'active_support'
-require 'active_support/core_ext/class/attribute'
-require 'active_support/core_ext/array/grouping'
-require 'active_support/core_ext/object/try'
-require 'active_support/core_ext/hash/reverse_merge'
-
-require 'portmidi'
-require 'radspberry/RAFL_wav'
-
-require 'radspberry/ruby_extensions'
-require 'radspberry/midi'
-require 'radspberry/dsp/math'
-require 'radspberry/dsp/base'
-require 'radspberry/dsp/speaker'
-require 'radspberry/dsp/oscillator'
-require 'radspberry/dsp/filter'
-require 'radspberry/dsp/super_saw'
+# drivers load on first use, so scripts that never touch the speaker
+# start fast and work on machines without portaudio/portmidi
+module DSP
+  autoload :Speaker,     'radspberry/dsp/speaker'
+  autoload :AudioStream, 'radspberry/dsp/speaker'
+end
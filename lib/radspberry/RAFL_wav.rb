@@ -14,16 +14,78 @@
 # BEXT writing
 # Fix Peak & RMS calculation on 24 bit audio
 
-require 'rexml/document'
-include REXML
-
 class RiffFile
   
   VALID_RIFF_TYPES = [ 'WAVE' ]
+  VALID_RIFF_IDS = [ 'RIFF', 'RF64' ]
   HEADER_PACK_FORMAT = "A4V"
   AUDIO_PACK_FORMAT_16 = "s*"
+  AUDIO_PACK_FORMAT_32 = "l<*"
+  AUDIO_PACK_FORMAT_FLOAT = "e*"
+  FORMAT_PCM   = 1
+  FORMAT_FLOAT = 3
+  FORMAT_EXTENSIBLE = 0xFFFE
+  
+  RIFF_LIMIT   = 0xFFFFFFFF  # largest riff length before we have to switch to RF64
+  SIZE_IN_DS64 = 0xFFFFFFFF  # 32 bit size placeholder, real one is in ds64
+  DS64_LENGTH  = 28
+  DS64_PACK_FMT = "Q<Q<Q<V"  # riff size, data size, sample count, table length
+  
+  PROBE_BYTES = 4096  # enough for the fmt and data headers of most files
+  
+  attr_accessor :format, :found_chunks, :raw_audio_data
+  attr_writer :bext_meta, :ixml_meta
+  attr_reader :chunks
+  attr_accessor :riff_limit  # lower it to exercise RF64 without writing 4GB
+  
+  Probe = Struct.new(:audio_format, :channels, :sample_rate, :bit_depth, :frames) do
+    def duration
+      frames.to_f / sample_rate
+    end
+  end
   
-  attr_accessor :format, :found_chunks, :bext_meta, :ixml_meta, :raw_audio_data
+  # format, channel count, rate and frame count from a single small read
+  # (more only if metadata chunks push the data header past PROBE_BYTES).
+  # returns nil for anything that isn't a readable wav
+  def self.probe(path)
+    File.open(path, 'rb') do |file|
+      head = file.read(PROBE_BYTES) || ""
+      riff, riff_type = head.unpack("A4x4A4")
+      return nil unless VALID_RIFF_IDS.include?(riff) && VALID_RIFF_TYPES.include?(riff_type)
+      
+      read_at = lambda do |position, length|
+        if position + length <= head.size
+          head[position, length]
+        else
+          file.seek(position)
+          file.read(length)
+        end
+      end
+      
+      format = ds64 = nil
+      position = 12
+      while (header = read_at[position, 8]) && header.size == 8
+        chunk_name, chunk_length = header.unpack(HEADER_PACK_FORMAT)
+        case chunk_name
+          when 'ds64'
+            data = read_at[position + 8, DS64_LENGTH]
+            return nil unless data && data.size == DS64_LENGTH  # truncated
+            ds64 = data.unpack(DS64_PACK_FMT)
+          when 'fmt'
+            data = read_at[position + 8, chunk_length]
+            return nil unless data && data.size >= 16 && chunk_length >= 16  # truncated
+            format = WaveFmtChunk.new(data)
+            return nil unless format.num_channels > 0 && format.block_align > 0
+          when 'data'
+            return nil unless format
+            chunk_length = ds64[1] if ds64 && chunk_length == SIZE_IN_DS64
+            return Probe.new(format.sample_format, format.num_channels, format.sample_rate,
+                             format.bit_depth, chunk_length / format.block_align)
+        end
+        position += 8 + chunk_length + chunk_length % 2
+      end
+    end
+  end
   
   def initialize(file, mode)
     @file = File.open(file, mode)
@@ -44,7 +106,8 @@ class RiffFile
   def riff?
     @file.seek(0)
     riff, @file_end = read_chunk_header
-    return true if riff == 'RIFF'
+    @file_end += 8 if @file_end  # the riff length doesn't count its own header
+    return true if VALID_RIFF_IDS.include?(riff)
   end
   
   def riff_type
@@ -54,14 +117,17 @@ class RiffFile
     end
   end
   
+  # only records where each chunk lives; fmt and data are cheap and needed
+  # for everything, metadata is parsed on first access
   def read_chunks
     @found_chunks = []
-    while @file.tell < @file_end
-      @file.seek(@file.tell + @file.tell % 2)  #adds padding if last chunk was an odd length
+    @chunks = {}
+    file_end = [@file_end, @file.size].min  # tolerate truncated files
+    while @file.tell + 8 <= file_end
       chunk_name, chunk_length = read_chunk_header
       chunk_position = @file.tell
-      identify_chunk(chunk_name, chunk_position, chunk_length)
-      @file.seek(chunk_position + chunk_length)
+      chunk_length = identify_chunk(chunk_name, chunk_position, chunk_length)
+      @file.seek(chunk_position + chunk_length + chunk_length % 2)  #skips padding if chunk has an odd length
     end
   end
   
@@ -71,12 +137,28 @@ class RiffFile
   
   def identify_chunk(chunk_name, chunk_position, chunk_length)
     @found_chunks << chunk_name
+    chunk_length = @ds64[1] if chunk_name == 'data' && @ds64 && chunk_length == SIZE_IN_DS64
+    @chunks[chunk_name] ||= [chunk_position, chunk_length]
     case chunk_name
+      when 'ds64' then process_ds64_chunk(chunk_position, chunk_length)
       when 'fmt' then process_fmt_chunk(chunk_position, chunk_length)
-      when 'bext' then process_bext_chunk(chunk_position, chunk_length)
       when 'data' then process_data_chunk(chunk_position, chunk_length)
-      when 'iXML' then process_ixml_chunk(chunk_position, chunk_length)
     end
+    chunk_length
+  end
+  
+  def process_ds64_chunk(chunk_position, chunk_length)
+    @file.seek(chunk_position)
+    @ds64 = @file.read(DS64_LENGTH).unpack(DS64_PACK_FMT)
+    @rf64 = true
+  end
+  
+  def bext_meta
+    @bext_meta ||= @chunks && @chunks['bext'] && process_bext_chunk(*@chunks['bext'])
+  end
+  
+  def ixml_meta
+    @ixml_meta ||= @chunks && @chunks['iXML'] && process_ixml_chunk(*@chunks['iXML'])
   end
   
   def process_fmt_chunk(chunk_position, chunk_length)
@@ -103,18 +185,26 @@ class RiffFile
     @ixml_meta = IxmlChunk.new(@file.read(chunk_length))
   end
   
-  def unpack_samples(samples, bit_depth)
-    if bit_depth == 24
+  def unpack_samples(samples, bit_depth, audio_format = FORMAT_PCM)
+    if audio_format == FORMAT_FLOAT
+      return samples.unpack(AUDIO_PACK_FORMAT_FLOAT)
+    elsif bit_depth == 24
       #return samples.scan(/.../).map {|s| (s.reverse + 0.chr ).unpack("V")}.flatten
-      return samples.scan(/.../).map {|s| (s + 0.chr).unpack("V")}.flatten
+      return samples.scan(/.../m).map {|s| (0.chr + s).unpack("l<")[0] >> 8 } # shift keeps the sign
+    elsif bit_depth == 32
+      return samples.unpack(AUDIO_PACK_FORMAT_32)
     else
       return samples.unpack(AUDIO_PACK_FORMAT_16)
     end
   end
   
-  def pack_samples(samples, bit_depth)
-    if bit_depth == 24
-      return samples.map { |s| [s].pack("VX") }.join
+  def pack_samples(samples, bit_depth, audio_format = FORMAT_PCM)
+    if audio_format == FORMAT_FLOAT
+      return samples.pack(AUDIO_PACK_FORMAT_FLOAT)
+    elsif bit_depth == 24
+      return samples.pack(AUDIO_PACK_FORMAT_32).unpack("a3x" * samples.size).join # low 3 bytes of each
+    elsif bit_depth == 32
+      return samples.pack(AUDIO_PACK_FORMAT_32)
     else
       return samples.pack(AUDIO_PACK_FORMAT_16)
     end
@@ -132,7 +222,24 @@ class RiffFile
   def simple_read #returns all sample values for entire file
     @file.seek(@data_begin)
     #@file.read(@data_end - @data_begin).unpack(@audio_pack_format)#.join.to_i
-    unpack_samples(@file.read(@data_end - @data_begin), @format.bit_depth)
+    unpack_samples(@file.read(@data_end - @data_begin), @format.bit_depth, @format.sample_format)
+  end
+  
+  def each_block(frames = 4096) #yields interleaved sample values a block at a time, in constant memory
+    return enum_for(:each_block, frames) unless block_given?
+    block_bytes = frames * @format.block_align
+    position = @data_begin
+    data_end = [@data_end, @file.size].min  # a truncated file just ends early
+    while position < data_end
+      @file.seek(position)
+      bytes = @file.read([block_bytes, data_end - position].min)
+      yield unpack_samples(bytes, @format.bit_depth, @format.sample_format)
+      position += bytes.size
+    end
+  end
+  
+  def full_scale #sample value of 0dBfs
+    @format.sample_format == FORMAT_FLOAT ? 1.0 : 2 ** (@format.bit_depth - 1)
   end
   
   def read_samples_by_channel(channel) #returns all of the sample values for a single audio channel
@@ -145,16 +252,72 @@ class RiffFile
     return samples
   end
   
-  def write(channels, sample_rate, bit_depth, audio_data) #writes to audio file
-    write_riff_type
-    write_fmt_chunk(channels, sample_rate, bit_depth)
+  def write(channels, sample_rate, bit_depth, audio_data, audio_format = FORMAT_PCM) #writes to audio file
+    begin_data(channels, sample_rate, bit_depth, audio_format)
     write_data_chunk audio_data #channels==1 ? [[*audio_data]] : audio_data
-    write_riff_header
+    finish_data
   end
   
   def write_riff_header
     @file.seek(0)
-    @file.print(["RIFF", @file_end].pack(HEADER_PACK_FORMAT))
+    if @rf64
+      @file.print(["RF64", SIZE_IN_DS64].pack(HEADER_PACK_FORMAT))
+    else
+      @file.print(["RIFF", @file_end - 8].pack(HEADER_PACK_FORMAT))
+    end
+  end
+  
+  #####################
+  # streaming writer: write the header up front, append packed frames as
+  # they arrive and call update_sizes now and then so the header always
+  # describes what is already on disk.
+  # a JUNK chunk reserves room for ds64, so once the file outgrows 32 bit
+  # sizes update_sizes turns it into RF64 in place, no second pass needed
+  #####################
+  
+  # extensible defaults to what the spec asks for: more than 2 channels or 16 bits
+  def begin_data(channels, sample_rate, bit_depth, audio_format = FORMAT_PCM, extensible = nil)
+    extensible = channels > 2 || bit_depth > 16 if extensible.nil?
+    @riff_limit ||= RIFF_LIMIT
+    write_riff_type
+    write_junk_chunk
+    write_fmt_chunk(channels, sample_rate, bit_depth, audio_format, extensible)
+    @data_chunk_begin = @file.tell
+    @file.print(["data", 0].pack(HEADER_PACK_FORMAT))
+    @data_begin = @data_end = @file_end = @file.tell
+    update_sizes
+  end
+  
+  def append_data(bytes)
+    @file.seek(@data_end)
+    @file.print(bytes)
+    @data_end = @file_end = @file.tell
+  end
+  
+  def update_sizes
+    @rf64 ||= @file_end - 8 > @riff_limit
+    @file.seek(@data_chunk_begin)
+    if @rf64
+      @file.print(["data", SIZE_IN_DS64].pack(HEADER_PACK_FORMAT))
+      write_ds64_chunk
+    else
+      @file.print(["data", @data_end - @data_begin].pack(HEADER_PACK_FORMAT))
+    end
+    write_riff_header
+    @file.flush
+  end
+  
+  def finish_data
+    if (@data_end - @data_begin).odd?  # chunks are word aligned
+      @file.seek(@data_end)
+      @file.print(0.chr)
+      @file_end = @file.tell
+    end
+    update_sizes
+  end
+  
+  def rf64?
+    !!@rf64
   end
   
   def write_riff_type
@@ -162,23 +325,32 @@ class RiffFile
     @file.print(["WAVE"].pack("A4"))
   end
   
-  def write_fmt_chunk(num_channels, sample_rate, bit_depth)
-    @file.seek(12)
+  def write_junk_chunk
+    @ds64_begin = @file.tell
+    @file.print(["JUNK", DS64_LENGTH].pack(HEADER_PACK_FORMAT))
+    @file.print(0.chr * DS64_LENGTH)
+  end
+  
+  def write_ds64_chunk
+    @file.seek(@ds64_begin)
+    @file.print(["ds64", DS64_LENGTH].pack(HEADER_PACK_FORMAT))
+    @file.print([@file_end - 8, @data_end - @data_begin, (@data_end - @data_begin) / @write_format.block_align, 0].pack(DS64_PACK_FMT))
+  end
+  
+  def write_fmt_chunk(num_channels, sample_rate, bit_depth, audio_format = FORMAT_PCM, extensible = false)
     @write_format = WaveFmtChunk.new
-    @write_format.audio_format = 1
+    @write_format.audio_format = audio_format
     @write_format.num_channels = num_channels
     @write_format.bit_depth = bit_depth
     @write_format.set_sample_rate(sample_rate)
+    @write_format.make_extensible if extensible
     
-    @file.print(["fmt ", 16].pack(HEADER_PACK_FORMAT)) # the 16 here means PCM, not bit depth
-    @file.print(@write_format.pack_header_data)
+    header_data = @write_format.pack_header_data
+    @file.print(["fmt ", header_data.size].pack(HEADER_PACK_FORMAT)) # 16 for plain PCM, 40 for extensible
+    @file.print(header_data)
   end
   
   def write_data_chunk(audio_data)
-    data_chunk_begin = @file.tell
-    @file.seek(8, IO::SEEK_CUR)
-    @data_begin = @file.tell
-    
     #interleave arrays
     if @write_format.num_channels > 1 && audio_data.length > 1
       interleaved_audio_data = audio_data[0].zip(*audio_data[1..-1]).flatten
@@ -186,18 +358,12 @@ class RiffFile
       interleaved_audio_data = audio_data[0]
     end
     
-    puts interleaved_audio_data.length
-    interleaved_audio_data.each_index do |sample|
-      if interleaved_audio_data[sample].nil?
-        puts "Sample number #{sample.to_s} is nil"
-      end
+    DSP::Log.debug "writing %d samples", interleaved_audio_data.length
+    if DSP::Log.enabled?(:warn) && (first_nil = interleaved_audio_data.index(nil))
+      DSP::Log.warn "sample number %d is nil (%d nil samples)", first_nil, interleaved_audio_data.count(nil)
     end
     
-    @file.print(pack_samples(interleaved_audio_data, @write_format.bit_depth))
-    @data_end = @file.tell
-    @file_end = @file.tell
-    @file.seek(data_chunk_begin)
-    @file.print(["data", @data_end - @data_begin].pack(HEADER_PACK_FORMAT))
+    append_data(pack_samples(interleaved_audio_data, @write_format.bit_depth, @write_format.sample_format))
   end
   
   def duration
@@ -213,9 +379,14 @@ class WaveFmtChunk
   
   attr_accessor :audio_format, :num_channels,
   :sample_rate, :byte_rate,
-  :block_align, :bit_depth
+  :block_align, :bit_depth,
+  :valid_bits, :channel_mask, :sub_format
 
   PACK_FMT = "vvVVvv"
+  EXTENSION_PACK_FMT = "vvVa16"  # cbSize, valid bits, channel mask, subformat GUID
+  EXTENSION_SIZE = 22
+  GUID_TAIL = "\x00\x00\x00\x00\x10\x00\x80\x00\x00\xAA\x00\x38\x9B\x71".b  # KSDATAFORMAT_SUBTYPE_* after the format tag
+  CHANNEL_MASKS = { 1 => 0x4, 2 => 0x3, 4 => 0x33, 6 => 0x3F, 8 => 0x63F }  # mono, stereo, quad, 5.1, 7.1
 
   def initialize(*binary_data)
     unpack_header_data(binary_data[0]) if !binary_data.empty?
@@ -225,12 +396,36 @@ class WaveFmtChunk
     @audio_format, @num_channels,
     @sample_rate, @byte_rate,
     @block_align, @bit_depth = binary_data.unpack(PACK_FMT)
+    if extensible? && binary_data.size >= 16 + 2 + EXTENSION_SIZE
+      cb_size, valid_bits, channel_mask, sub_format = binary_data[16..-1].unpack(EXTENSION_PACK_FMT)
+      # a shorter cbSize means the bytes after it aren't an extension
+      @valid_bits, @channel_mask, @sub_format = valid_bits, channel_mask, sub_format if cb_size >= EXTENSION_SIZE
+    end
   end
   
   def pack_header_data
-    [ @audio_format, @num_channels,
+    header = [ @audio_format, @num_channels,
     @sample_rate, @byte_rate,
     @block_align, @bit_depth ].pack(PACK_FMT)
+    header << [ EXTENSION_SIZE, @valid_bits, @channel_mask, @sub_format ].pack(EXTENSION_PACK_FMT) if extensible?
+    header
+  end
+  
+  def extensible?
+    @audio_format == RiffFile::FORMAT_EXTENSIBLE
+  end
+  
+  # PCM or float, looking through WAVE_FORMAT_EXTENSIBLE
+  def sample_format
+    extensible? && @sub_format ? @sub_format.unpack("v")[0] : @audio_format
+  end
+  
+  def make_extensible
+    return if extensible?
+    @valid_bits   ||= @bit_depth
+    @channel_mask ||= CHANNEL_MASKS[@num_channels] || 0
+    @sub_format     = [@audio_format].pack("v") + GUID_TAIL
+    @audio_format   = RiffFile::FORMAT_EXTENSIBLE
   end
   
   def set_sample_rate(rate)
@@ -240,7 +435,7 @@ class WaveFmtChunk
   end
   
   def calc_block_align
-    @num_channels * (@bit_depth)
+    @num_channels * (@bit_depth / 8)
   end
 
   def calc_byte_rate(sample_rate, num_channels = @num_channels, bit_depth = @bit_depth)
@@ -304,7 +499,8 @@ class IxmlChunk
   end
   
   def unpack_ixml_data(binary_data)
-    @raw_xml = Document.new(binary_data.unpack(PACK_FMT)[0])
+    require 'rexml/document'  # only pay for REXML when a file has iXML
+    @raw_xml = REXML::Document.new(binary_data.unpack(PACK_FMT)[0])
     #read_xml_values
   end
   
@@ -0,0 +1,51 @@
+# core DSP and file i/o, without any audio or MIDI drivers.
+# offline tools (render workers, file converters) can require just this:
+#
+#   require 'radspberry/core'
+#
+# 'radspberry' adds autoloads for Speaker and friends on top of it.
+
+require 'matrix'
+
+# require 'active_support'
+require 'active_support/core_ext/class/attribute'
+require 'active_support/core_ext/array/grouping'
+require 'active_support/core_ext/object/try'
+require 'active_support/core_ext/hash/reverse_merge'
+
+require 'radspberry/ruby_extensions'
+require 'radspberry/dsp/ring_buffer'
+require 'radspberry/dsp/log'  # first, so its exit flush runs after every other hook
+require 'radspberry/midi'
+require 'radspberry/midi_file'
+require 'radspberry/dsp/math'
+require 'radspberry/dsp/base'
+require 'radspberry/dsp/param_map'
+require 'radspberry/dsp/quantizer'
+require 'radspberry/dsp/oscillator'
+require 'radspberry/dsp/envelope'
+require 'radspberry/dsp/mod_matrix'
+require 'radspberry/dsp/automation'
+require 'radspberry/dsp/sequencer'
+require 'radspberry/dsp/poly'
+require 'radspberry/midi_clock'
+require 'radspberry/dsp/filter'
+require 'radspberry/dsp/fft'
+require 'radspberry/dsp/fir'
+require 'radspberry/dsp/convolver'
+require 'radspberry/dsp/super_saw'
+
+require 'radspberry/RAFL_wav'
+require 'radspberry/flac'
+require 'radspberry/dsp/recorder'
+require 'radspberry/dsp/pcm_sink'
+require 'radspberry/dsp/shared_memory'
+require 'radspberry/dsp/shm_ring'
+require 'radspberry/dsp/param_block'
+require 'radspberry/dsp/osc_server'
+require 'radspberry/sample_index'
+require 'radspberry/peak_file'
+require 'radspberry/sample_cache'
+require 'radspberry/pipeline'
+require 'radspberry/dsp/virtual_time'
+require 'radspberry/midi_render'
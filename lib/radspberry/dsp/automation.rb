@@ -0,0 +1,131 @@
+module DSP
+
+  # breakpoint automation of a synth's parameters, one lane per ParamMap
+  # path. time is counted in samples rendered, and values are set on a
+  # fixed grid of control periods plus the breakpoints themselves, so a
+  # lane plays back the same whatever the block sizes, under Speaker or in
+  # to_wav. within a segment the value is set once per control period, or
+  # as per-sample ramps for audio rate parameters.
+  #
+  #   chain = XFader[ SuperSaw.new, RpmNoise.new ]
+  #   auto  = Automation.new( chain )
+  #   auto.lane "fade", [[0, 0.0], [5, 0.0], [10, 1.0]]
+  #   auto.lane "a.freq", [[0, 110], [4, 440, :exp], [6, 220, :step]]
+  #   Speaker[ auto ]        # or auto.to_wav( 10 )
+  #
+  # points are [seconds, value, curve], the curve shaping the segment that
+  # ends on the point: :linear, :exp (constant ratio, for frequencies) or
+  # :step (jumps when the point is reached). values hold before the first
+  # point and after the last.
+  class Automation < Controller
+    CURVES = [:linear, :exp, :step]
+
+    class Lane
+      attr_reader :param, :points
+
+      def initialize param, points=[]
+        @param  = param
+        @points = []
+        @i      = 0  # segment cursor: points[@i] is the last one reached
+        points.each{ |p| add( *p ) }
+      end
+
+      def add seconds, value, curve=:linear
+        raise ArgumentError, "unknown curve #{curve}, choose from #{CURVES}" unless CURVES.include?( curve )
+        at = (seconds * Base.sampleRate).round
+        @points.insert( @points.index{ |p| p[0] > at } || @points.size, [at, value.to_f, curve] )
+        @i = 0
+        self
+      end
+
+      # samples from pos to the next point after it
+      def until_next pos
+        seek( pos )
+        p = @points[0] && @points[0][0] > pos ? @points[0] : @points[@i + 1]
+        p ? p[0] - pos : Float::INFINITY
+      end
+
+      def value_at pos
+        seek( pos )
+        a, b = @points[@i], @points[@i + 1]
+        return a[1] unless b && pos >= a[0]
+        x = (pos - a[0]).to_f / (b[0] - a[0])
+        case b[2]
+        when :linear then a[1] + (b[1] - a[1]) * x
+        when :exp    then a[1] * b[1] > 0 ? a[1] * (b[1] / a[1]) ** x : a[1] + (b[1] - a[1]) * x
+        when :step   then a[1]
+        end
+      end
+
+      # the values for pos...pos + samples, all in one segment
+      def ramp pos, samples
+        from = value_at( pos )
+        a, b = @points[@i], @points[@i + 1]
+        return Array.new( samples, from ) unless b && pos >= a[0] && b[2] != :step
+        return Array.new( samples ){ |k| value_at( pos + k ) } if b[2] == :exp
+        v0, dv, t0, len = a[1], b[1] - a[1], pos - a[0], (b[0] - a[0]).to_f
+        Array.new( samples ){ |k| v0 + dv * ((t0 + k) / len) }  # as value_at, to the bit
+      end
+
+      private
+
+      def seek pos
+        @i = 0 if @points[@i] && @points[@i][0] > pos
+        @i += 1 while @points[@i + 1] && @points[@i + 1][0] <= pos
+      end
+    end
+
+    attr_reader :lanes, :params, :pos
+
+    def initialize synth, kperiod=LFO::KPERIOD
+      super synth
+      @params  = ParamMap.new( synth )
+      @kperiod = kperiod
+      @lanes   = {}
+      @pos     = 0
+    end
+
+    # the lane for path, created on first use; points are added to it
+    def lane path, points=[]
+      param = @params[path] or raise ArgumentError, "no parameter #{path}, choose from #{@params.paths}"
+      lane  = @lanes[param.path] ||= Lane.new( param )
+      points.each{ |p| lane.add( *p ) }
+      lane
+    end
+
+    def position
+      @pos * Base.inv_srate
+    end
+
+    def seek seconds
+      @pos = (seconds * Base.sampleRate).round
+    end
+
+    def rewind
+      seek( 0 )
+    end
+
+    def inputs
+      { "synth" => @synth }
+    end
+
+    def split samples
+      grid = @kperiod - @pos % @kperiod  # control points fall on the same samples whatever the block size
+      @lanes.each_value.inject( [samples, grid].min ){ |n,lane| [n, lane.until_next( @pos )].min }
+    end
+
+    def control samples
+      @lanes.each_value do |lane|
+        next if lane.points.empty?
+        param = lane.param
+        if samples > 1 && param.audio_rate?
+          param.target.send( param.buffer_setter, lane.ramp( @pos, samples ) )
+        else
+          param.set( lane.value_at( @pos ) )
+        end
+      end
+      @pos += samples
+    end
+  end
+
+end
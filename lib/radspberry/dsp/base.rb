@@ -28,6 +28,11 @@ module DSP
     def clear
     end
 
+    # named upstream nodes, for walking a graph (see ParamMap)
+    def inputs
+      {}
+    end
+
     # allows for setting multiple values at once
     def [] args={}
       args.each_pair{ |k,v| send "#{k}=", v }
@@ -55,25 +60,96 @@ module DSP
       end
     end
 
-    def to_wav( seconds, filename=nil )
-      filename ||= "#{self.class}.wav"    
+    # renders, normalizes to -0.5dBfs and writes through a Quantizer
+    # (TPDF dither, optional :shape => true noise shaping), :bits 16 or 24
+    def to_wav( seconds, filename=nil, opts={} )
+      filename ||= "#{self.class}.wav"
       filename += ".wav" unless filename =~ /\.wav$/i
+      opts = opts.reverse_merge :bits => 16, :normalize => -0.5
+      samples = (self.sampleRate * seconds).to_i
+      if block_given?
+        inv = 1.0 / samples
+        data = samples.times.map{ |s| yield(self, s * inv); self.tick }
+      else
+        data = self.ticks( samples ).to_a
+      end
+      peak = data.map(&:abs).max.to_f
+      gain = opts[:normalize] && peak > 0 ? 10 ** (opts[:normalize] / 20.0) / peak : 1.0
+      quantizer = Quantizer.new( opts[:bits], opts.merge( :gain => gain ) )
       RiffFile.new(filename,"wb+") do |wav|
-        samples = self.sampleRate * seconds
-        if block_given?
-          inv = 1.0 / samples
-          data = samples.times.map{ |s| yield(self, s * inv); self.tick }
-        else
-          data = self.ticks( samples )
+        wav.begin_data( 1, self.sampleRate.to_i, opts[:bits], RiffFile::FORMAT_PCM )
+        data.each_slice( 2**12 ){ |block| wav.append_data( quantizer.pack( block ) ) }
+        wav.finish_data
+      end
+    end
+
+    # renders block by block straight into a FlacFile, in bounded memory.
+    # encoding runs on a background thread unless :threaded => false
+    def to_flac( seconds, filename=nil, opts={} )
+      filename ||= "#{self.class}.flac"
+      filename += ".flac" unless filename =~ /\.flac$/i
+      bits  = opts[:bits] || 16
+      scale = 2 ** (bits - 1) - 1
+      FlacFile.new(filename,"wb") do |flac|
+        flac.begin_data( 1, self.sampleRate.to_i, bits, opts.reverse_merge( :threaded => true ) )
+        samples = (self.sampleRate * seconds).to_i
+        0.step( samples - 1, FlacFile::BLOCK_SIZE ) do |start|
+          data = self.ticks( [FlacFile::BLOCK_SIZE, samples - start].min ).to_a
+          flac.append_samples data.map{|d| (DSP.clamp(d, -1.0, 1.0) * scale).round }
         end
-        rescale = calc_sample_value(-0.5, 16) / [data.max, -data.max].max  # normalize to -0.5dBfs
-        data.map!{|d| (d*rescale).round.to_f.to_i }
-        wav.write(1, self.sampleRate, 16, [data] )
+        flac.finish_data
       end
     end
 
   end
 
+  # wraps a generator and gets a chance to change parameters before each
+  # block it renders. anything else goes to the wrapped synth, so things
+  # like Speaker.synth.freq keep working with a controller in between
+  class Controller < Generator
+    attr_reader :synth
+
+    def initialize synth
+      @synth = synth
+    end
+
+    def control samples
+    end
+
+    # how many of the next samples can run before control is due again.
+    # subclasses with timed events return the distance to the next one,
+    # and ticks renders the block in pieces between them
+    def split samples
+      samples
+    end
+
+    def tick
+      control( 1 )
+      @synth.tick
+    end
+
+    def ticks samples
+      n = [split( samples ), 1].max
+      return (control( samples ); @synth.ticks( samples )) if n >= samples
+      out = []
+      while samples > 0
+        control( n )
+        out.concat @synth.ticks( n ).to_a
+        samples -= n
+        n = [split( samples ), 1].max if samples > 0
+      end
+      out.to_v
+    end
+
+    def method_missing name, *args, &block
+      @synth.respond_to?( name ) ? @synth.send( name, *args, &block ) : super
+    end
+
+    def respond_to_missing? name, include_private=false
+      @synth.respond_to?( name, include_private ) || super
+    end
+  end
+
   class Processor < Base
     ANTI_DENORMAL = 1e-20
 
@@ -96,6 +172,10 @@ module DSP
     def self.[] *chain
       new(chain)
     end
+
+    def inputs
+      Hash[ @chain.each_with_index.map{|o,i| [i.to_s, o] } ]
+    end
   end
 
   class ProcessorChain < TickerChain
@@ -103,8 +183,9 @@ module DSP
       @gain * @chain.inject( input ){|x,o| o.tick(x) }
     end
 
-    def ticks samples
-      @gain * @chain.inject( Vector.zeros(samples) ){|x,o| o.ticks(x) }
+    def ticks inputs
+      out = @chain.inject( inputs ){|x,o| o.ticks(x) }
+      @gain == 1.0 ? out : out.map{|s| @gain * s }
     end
   end
 
@@ -119,6 +200,10 @@ module DSP
       @gain = 1.0 / Math.sqrt( @mix.size )
     end
 
+    def inputs
+      Hash[ @mix.each_with_index.map{|o,i| [i.to_s, o] } ]
+    end
+
     def tick
       @gain * @mix.tick_sum
     end
@@ -129,7 +214,7 @@ module DSP
   end
 
   class XFader < Generator
-    param_accessor :fade
+    param_accessor :fade, :audio_rate => true
 
     def self.[] *mix
       new mix[0], mix[1], mix[2]
@@ -141,6 +226,10 @@ module DSP
       @a,@b = a,b
     end
 
+    def inputs
+      { "a" => @a, "b" => @b }
+    end
+
     def tick
       DSP.xfade @a.tick, @b.tick, @fade
     end
@@ -148,6 +237,12 @@ module DSP
     def ticks samples
       a = @a.ticks(samples)
       b = @b.ticks(samples)
+      if (f = @fade_buffer) && f.size == samples  # audio rate fade, e.g. from a ModMatrix
+        @fade_buffer = nil
+        @fade = f.last
+        a, b = a.to_a, b.to_a
+        return Array.new( samples ){|i| a[i] + (b[i]-a[i])*f[i] }.to_v
+      end
       (b-a)*@fade + a  # TODO cos fade?
     end 
 
@@ -178,6 +273,10 @@ module DSP
       end
     end
 
+    def inputs
+      Hash[ @mix.each_with_index.map{|o,i| [i.to_s, o] } ]
+    end
+
     def tick
       @mix.each_with_index.inject( 0.0 ){|sum,(o,i)| sum + @gains[i] * o.tick }
     end
@@ -197,6 +296,10 @@ module DSP
       end
     end
 
+    def inputs
+      Hash[ ([@gen] + @chain).each_with_index.map{|o,i| [i.to_s, o] } ]
+    end
+
     def tick
       @gain * @chain.inject( @gen.tick ){|x,o| o.tick(x) }
     end
@@ -214,7 +317,7 @@ module DSP
   end
 
   class Oscillator < Generator
-    attr_accessor :freq
+    param_accessor :freq, :range => false
     DEFAULT_FREQ = MIDI::A / 2
 
     def initialize freq=DEFAULT_FREQ
@@ -253,21 +356,127 @@ module DSP
 
   end
 
+  # low frequency oscillator for modulation. the waveform is only worked
+  # out once per control period (kperiod samples): controllers that set a
+  # parameter once per block call advance( samples ) and use the value,
+  # and tick/ticks ramp linearly between control points for destinations
+  # that need audio rate. output is bipolar, -1..1.
+  #
+  #   vibrato = LFO.new( 5.0, :tri )
+  #   wobble  = LFO.new( 1.0, :square ).sync( 128, 1.0/2 )  # eighth notes at 128bpm
   class LFO < Oscillator
+    include DSP::Math
 
+    SHAPES  = [:sine, :tri, :saw, :square, :sample_hold, :smooth]
+    KPERIOD = 64
+
+    attr_reader :shape, :value, :beats
+    attr_accessor :phase
+
+    def initialize freq=1.0, shape=:sine, opts={}
+      opts = opts.reverse_merge :phase => 0.0, :kperiod => KPERIOD
+      self.shape = shape
+      @kperiod = opts[:kperiod]
+      @phase   = opts[:phase].to_f
+      @last, @next = DSP.noise, DSP.noise  # random shapes: held and upcoming values
+      super freq
+      @value = wave
+      clear
+    end
+
+    def clear
+      @y, @dy, @left = @value, 0.0, 0
+    end
+
+    def freq= arg
+      @freq = arg
+      @inc  = @freq * inv_srate
+    end
+
+    def shape= arg
+      raise ArgumentError, "unknown LFO shape #{arg}, choose from #{SHAPES}" unless SHAPES.include?( arg )
+      @shape = arg
+    end
+
+    # locks the rate to a tempo, one cycle every beats beats
+    def sync bpm, beats=1
+      @beats = beats
+      self.tempo = bpm
+      self
+    end
+
+    def tempo= bpm
+      raise ArgumentError, "sync the LFO to a note length first" unless @beats
+      self.freq = bpm / 60.0 / @beats
+    end
+
+    # moves on samples and returns the waveform there
+    def advance samples
+      @phase += @inc * samples
+      if @phase >= 1.0
+        @phase -= @phase.floor
+        @last, @next = @next, DSP.noise
+      end
+      @value = wave
+    end
+
+    def tick
+      step if @left == 0
+      @left -= 1
+      @y += @dy
+    end
+
+    def ticks samples
+      out = Array.new( samples )
+      i = 0
+      while i < samples
+        step if @left == 0
+        n = [@left, samples - i].min
+        y, dy, last = @y, @dy, i + n
+        while i < last
+          out[i] = y += dy
+          i += 1
+        end
+        @y = y
+        @left -= n
+      end
+      out.to_v
+    end
+
+    private
+
+    # the next control point, and the ramp to it
+    def step
+      @y    = @value
+      @dy   = (advance( @kperiod ) - @y) / @kperiod
+      @left = @kperiod
+    end
+
+    def wave
+      p = @phase
+      case @shape
+      when :sine        then sin( TWO_PI * p )
+      when :tri         then 1.0 - 4.0 * (p - 0.5).abs
+      when :saw         then 2.0 * p - 1.0
+      when :square      then p < 0.5 ? 1.0 : -1.0
+      when :sample_hold then @last
+      when :smooth      then @last + (@next - @last) * (0.5 - 0.5 * cos( PI * p ))
+      end
+    end
   end
 
+  # random steps at freq, exact to the sample (a control period of one)
   class SampleHold < LFO
     def initialize freq = DEFAULT_FREQ, phase = DSP.random
-      @latch = Decimator.new( freq, phase )
+      super freq, :sample_hold, :phase => phase, :kperiod => 1
     end
 
-    def freq= arg
-      @latch.freq = arg
+    def tick
+      advance( 1 )
     end
 
-    def tick
-      @latch.tick( DSP.noise )
+    def ticks samples
+      Array.new( samples ){ advance( 1 ) }.to_v
     end
   end
 
@@ -282,11 +491,21 @@ module DSP
   class SampleGlide < SampleHold
     def initialize freq = DEFAULT_FREQ, phase = DSP.random
       @slew = Lowpass.new( 0.5/freq )
+      super
+    end
+
+    def freq= arg
+      super
+      @slew.tau = 0.5/arg if @slew
     end
 
     def tick
       @slew.tick( super )
     end
+
+    def ticks samples
+      @slew.ticks( super.to_a ).to_v
+    end
   end
 
   class OnePole < Processor 
@@ -319,7 +538,7 @@ module DSP
 
   class Lowpass < OnePole  # envelope smoother, etc.
     def initialize tau
-      tau = tau
+      self.tau = tau
       clear
     end
 
@@ -0,0 +1,186 @@
+module DSP
+
+  # zero latency convolution with long impulse responses (reverbs), using
+  # partitions that grow along the IR:
+  #
+  #   ir[0, block)             direct FIR, on the current input
+  #   ir[block, 2 * N1)        block sized FFT partitions, in the audio call
+  #   ir[2 * N1, 2 * N2) ...   N1 = growth * block sized partitions, and so on
+  #
+  # a level of partition size N starts 2N into the IR, so its next output
+  # block only depends on input that is already a whole block old: each
+  # one runs on its own worker thread, gets the input as a block fills and
+  # has N samples (one block of its own) before the result is due. the
+  # audio side only waits if a worker misses that deadline (counted in
+  # #late). a worker that raises hands the error to the audio side, which
+  # re-raises it from #ticks. with :threads => false every level runs
+  # inline, for offline renders where determinism beats spreading the work.
+  # #close (or, failing that, garbage collection) stops the workers.
+  #
+  #   verb = Convolver.new( RiffFile.new( "hall.wav", "r" ).simple_read.map{ |s| s / 32768.0 } )
+  #   Speaker[ GeneratorChain[ SuperSaw.new, verb ] ]
+  class Convolver < Processor
+    attr_reader :levels
+
+    def initialize ir, opts={}
+      opts  = opts.reverse_merge :block => 64, :growth => 4, :max_partition => 16384, :threads => true
+      block = opts[:block]
+      ir    = ir.map(&:to_f)
+      @block = block
+      @phase = 0  # position in the current block
+      @head  = FIR.new( ir[0, block] )
+      @levels = []
+      size, start = block, block
+      while start < ir.size
+        grown = [[size * opts[:growth], opts[:max_partition]].min, size].max
+        stop  = grown == size ? ir.size : [2 * grown, ir.size].min  # the last level takes the rest
+        @levels << Level.new( ir, size, start, stop, opts[:threads] && start > size )
+        size, start = grown, stop
+      end
+      ObjectSpace.define_finalizer( self, Convolver.closer( @levels ) ) if @levels.any?( &:threaded? )
+    end
+
+    # the workers hold their levels, not us, so this can still run
+    def self.closer levels
+      proc{ levels.each( &:close ) }
+    end
+
+    # blocks a worker had not finished on time
+    def late
+      @levels.inject( 0 ){ |n,l| n + l.late }
+    end
+
+    def tick input
+      ticks( [input] )[0]
+    end
+
+    def ticks inputs
+      inputs = inputs.to_a
+      out = []
+      pos = 0
+      while pos < inputs.size  # chunks never straddle a block boundary
+        len   = [@block - @phase, inputs.size - pos].min
+        chunk = inputs[pos, len]
+        y = @head.ticks( chunk )
+        @levels.each{ |level| level.add( chunk, y ) }
+        out.concat( y )
+        pos += len
+        @phase = (@phase + len) % @block
+      end
+      out
+    end
+
+    def clear
+      @head.clear
+      @levels.each( &:clear )
+      @phase = 0
+    end
+
+    def close
+      @levels.each( &:close )
+    end
+
+    # uniformly partitioned overlap-save over one stretch of the IR, with
+    # a frequency domain delay line of past input blocks
+    class Level
+      attr_reader :size, :late
+
+      def initialize ir, size, start, stop, threaded
+        @size  = size
+        @first = start / size  # partition index of start: 1 inline, 2 threaded
+        @fft   = FFT[2 * size]
+        @parts = (start...stop).step( size ).map{ |o| FFT.spectrum( ir[o, [size, stop - o].min], 2 * size ) }
+        @late  = 0
+        if threaded
+          @jobs, @results = Queue.new, Queue.new
+          @worker = Thread.new do
+            begin
+              while (frame = @jobs.pop); @results << compute( frame ); end
+            rescue StandardError => e
+              @results << e
+              @results.close  # nothing more is coming: later pops return nil
+            end
+          end
+        end
+        clear
+      end
+
+      def threaded?
+        !!@worker
+      end
+
+      def clear
+        @in_flight.times{ @results.pop } if @in_flight  # let the worker finish
+        @in_flight = 0
+        @fdl    = []
+        @prev   = Array.new( @size, 0.0 )
+        @input  = Array.new( @size, 0.0 )
+        @output = Array.new( @size, 0.0 )
+        @queued = Array.new( @first - 1 ){ Array.new( @size, 0.0 ) }  # outputs due before the first result
+        @fill   = 0
+      end
+
+      # adds this level's output for the chunk to y and takes the chunk in
+      def add chunk, y
+        f = @fill
+        o = @output
+        chunk.each_index{ |i| y[i] += o[f + i]; @input[f + i] = chunk[i] }
+        complete if (@fill += chunk.size) == @size
+      end
+
+      def close
+        @jobs << nil if @jobs
+      end
+
+      private
+
+      def complete
+        frame = @prev + @input
+        @prev, @input = @input, @prev
+        @fill = 0
+        if @jobs
+          @jobs << frame
+          @in_flight += 1
+          @output = @queued.empty? ? result : @queued.shift
+        else
+          @queued << compute( frame )
+          @output = @queued.shift
+        end
+      end
+
+      def result
+        @late += 1 if @results.empty?
+        @in_flight -= 1
+        out = @results.pop
+        case out
+        when Array     then out
+        when Exception then raise( @error = out )
+        else raise @error  # the worker is gone
+        end
+      end
+
+      # the output block first partitions from now: sum of past input
+      # spectra times partition spectra, back to time, second half
+      def compute frame
+        n = 2 * @size
+        re, im = frame, Array.new( n, 0.0 )
+        @fft.forward( re, im )
+        @fdl.unshift( [re, im] )
+        @fdl.pop if @fdl.size > @parts.size
+        zr, zi = Array.new( n, 0.0 ), Array.new( n, 0.0 )
+        @fdl.each_with_index do |(xr, xi), p|
+          hr, hi = @parts[p]
+          k = 0
+          while k < n
+            zr[k] += xr[k] * hr[k] - xi[k] * hi[k]
+            zi[k] += xr[k] * hi[k] + xi[k] * hr[k]
+            k += 1
+          end
+        end
+        @fft.inverse( zr, zi )
+        zr[@size, @size]
+      end
+    end
+  end
+
+end
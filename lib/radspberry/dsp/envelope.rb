@@ -0,0 +1,165 @@
+module DSP
+
+  # multi-segment envelope. each segment heads for a level over a time,
+  # either in a straight line or exponentially, and both are run as the
+  # same multiply-add recurrence y = y * c + b: the coefficients are worked
+  # out once when a segment starts (from wherever the level is, so
+  # retriggers don't click) and a whole run of a segment within a block
+  # is one tight loop. idle and sustain stretches are a single fill.
+  #
+  #   env = Envelope.adsr( 0.01, 0.2, 0.6, 0.5 )
+  #   env.trigger            # at the start of the next block
+  #   env.release( 100 )     # 100 samples into the next block
+  #   env.ticks( 256 )
+  #
+  # segments are [level, seconds, shape]. shape is :linear, or the
+  # overshoot ratio of the exponential: small is steep and rounded (decays,
+  # releases), large is close to linear. segments after the sustain index
+  # run on release; with none (no sustain index, or it's the last segment)
+  # release fades to zero over RELEASE seconds instead of holding the level.
+  class Envelope < Generator
+    Segment = Struct.new( :level, :time, :shape )
+
+    LINEAR = :linear
+    ATTACK = 0.3    # overshoot ratios, as in analog envelopes
+    DECAY  = 0.001
+    RELEASE = 0.01  # seconds, for envelopes without release segments
+
+    attr_reader :level, :segments, :sustain
+
+    def self.adsr attack, decay, sustain, release
+      new( [[1.0, attack, ATTACK], [sustain, decay, DECAY], [0.0, release, DECAY]], 1 )
+    end
+
+    # one-shot attack-decay, for percussive sounds
+    def self.ad attack, decay
+      new( [[1.0, attack, ATTACK], [0.0, decay, DECAY]] )
+    end
+
+    def initialize segments, sustain=nil
+      @segments = segments.map{ |s| Segment.new( s[0].to_f, s[1].to_f, s[2] || DECAY ) }
+      @sustain  = sustain
+      @release  = Segment.new( 0.0, RELEASE, DECAY )  # runs as stage segments.size
+      @events   = []  # [offset, stage, scale], sorted by offset
+      @level    = 0.0
+      @scale    = 1.0
+      @stage    = nil  # running segment, nil when idle or sustaining
+      @left     = 0
+    end
+
+    def idle?
+      @stage.nil? && @level == 0.0 && @events.empty?
+    end
+
+    # starts from the first segment offset samples into the next block,
+    # with levels scaled by velocity
+    def trigger velocity=1.0, offset=0
+      schedule( offset, 0, velocity.to_f )
+    end
+
+    def release offset=0
+      schedule( offset, @sustain ? @sustain + 1 : @segments.size, nil )
+    end
+
+    def tick
+      ticks( 1 )[0]
+    end
+
+    def ticks samples
+      out = Array.new( samples )
+      pos = 0
+      while pos < samples
+        stop = @events.empty? || @events[0][0] >= samples ? samples : [@events[0][0], pos].max
+        pos = run( out, pos, stop )
+        next unless pos == stop && stop < samples
+        _, stage, scale = @events.shift
+        @scale = scale if scale
+        start( stage )
+      end
+      @events.each{ |e| e[0] -= samples }
+      out.to_v
+    end
+
+    private
+
+    def schedule offset, stage, scale
+      i = @events.index{ |e| e[0] > offset } || @events.size
+      @events.insert( i, [offset, stage, scale] )
+    end
+
+    def start stage
+      @stage = stage > @segments.size ? nil : stage
+      return unless @stage
+      seg = @segments[@stage] || @release
+      @target = seg.level * @scale
+      @left   = (seg.time * srate).round
+      if @left == 0
+        @level = @target
+        return finish
+      end
+      if seg.shape == LINEAR
+        @c, @b = 1.0, (@target - @level) / @left
+      else
+        r  = seg.shape.to_f
+        @c = (r / (1.0 + r)) ** (1.0 / @left)
+        @b = (@target + r * (@target - @level)) * (1.0 - @c)  # heads past the target by r
+      end
+    end
+
+    def finish
+      @level = @target  # land exactly, whatever the rounding on the way
+      if @stage == @sustain || @stage + 1 >= @segments.size  # the release segment only runs on release
+        @stage = nil
+      else
+        start( @stage + 1 )
+      end
+    end
+
+    # fills out[pos...stop], segment by segment
+    def run out, pos, stop
+      while pos < stop
+        unless @stage  # idle or sustaining
+          out.fill( @level, pos, stop - pos )
+          return stop
+        end
+        n = [@left, stop - pos].min
+        y, c, b = @level, @c, @b
+        i, last = pos, pos + n
+        while i < last
+          out[i] = y = y * c + b
+          i += 1
+        end
+        @level = y
+        pos = last
+        finish if (@left -= n) == 0
+      end
+      pos
+    end
+  end
+
+  # scales a synth by an envelope, and passes anything else (freq=,
+  # params) through to the synth
+  class VCA < Controller
+    attr_reader :env
+
+    def initialize synth, env=Envelope.adsr( 0.005, 0.1, 0.8, 0.2 )
+      super synth
+      @env = env
+    end
+
+    def inputs
+      { "synth" => @synth, "env" => @env }
+    end
+
+    def tick
+      @env.idle? ? (@synth.tick; 0.0) : @synth.tick * @env.tick
+    end
+
+    def ticks samples
+      s = @synth.ticks( samples ).to_a
+      e = @env.ticks( samples ).to_a
+      Array.new( samples ){ |i| s[i] * e[i] }.to_v
+    end
+  end
+
+end
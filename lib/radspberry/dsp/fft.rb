@@ -0,0 +1,100 @@
+module DSP
+
+  # iterative radix-2 complex FFT, in place on separate real and imaginary
+  # arrays. the bit reversal table and twiddles are computed once per size
+  # and shared: FFT[1024] always returns the same instance.
+  #
+  #   re, im = FFT.spectrum( taps, 1024 )
+  #   FFT[1024].inverse( re, im )
+  class FFT
+    attr_reader :size
+
+    def self.[] size
+      (@instances ||= {})[size] ||= new( size )
+    end
+
+    # the smallest power of two >= n
+    def self.size_for n
+      size = 1
+      size <<= 1 while size < n
+      size
+    end
+
+    # forward transform of real samples, zero padded to size
+    def self.spectrum samples, size
+      re = samples + Array.new( size - samples.size, 0.0 )
+      im = Array.new( size, 0.0 )
+      self[size].forward( re, im )
+      [re, im]
+    end
+
+    def initialize size
+      raise ArgumentError, "FFT size must be a power of two, not #{size}" unless size > 0 && size & (size - 1) == 0
+      @size = size
+      bits  = size.bit_length - 1
+      @rev  = Array.new( size ){ |i| i.to_s( 2 ).rjust( bits, "0" ).reverse.to_i( 2 ) }
+      @cos  = Array.new( size / 2 ){ |k| ::Math.cos( 2.0 * ::Math::PI * k / size ) }
+      @sin  = Array.new( size / 2 ){ |k| ::Math.sin( 2.0 * ::Math::PI * k / size ) }
+    end
+
+    def forward re, im
+      transform( re, im, -1.0 )
+    end
+
+    # scaled by 1/size, so inverse( forward( x ) ) == x
+    def inverse re, im
+      transform( re, im, 1.0 )
+      scale = 1.0 / @size
+      i = 0
+      while i < @size
+        re[i] *= scale
+        im[i] *= scale
+        i += 1
+      end
+      self
+    end
+
+    private
+
+    def transform re, im, sign
+      n, rev, cos, sin = @size, @rev, @cos, @sin
+      i = 0
+      while i < n
+        j = rev[i]
+        if j > i
+          re[i], re[j] = re[j], re[i]
+          im[i], im[j] = im[j], im[i]
+        end
+        i += 1
+      end
+      len = 2
+      while len <= n
+        half = len >> 1
+        step = n / len
+        start = 0
+        while start < n
+          j = start
+          k = 0
+          stop = start + half
+          while j < stop
+            wr = cos[k]
+            wi = sign * sin[k]
+            l  = j + half
+            tr = wr * re[l] - wi * im[l]
+            ti = wr * im[l] + wi * re[l]
+            re[l] = re[j] - tr
+            im[l] = im[j] - ti
+            re[j] += tr
+            im[j] += ti
+            k += step
+            j += 1
+          end
+          start += len
+        end
+        len <<= 1
+      end
+      self
+    end
+  end
+
+end
@@ -5,8 +5,9 @@ module DSP
     attr_accessor :state
     include Math
     
-    def initialize
-      freq = srate / 2.0
+    def initialize freq = srate / 2.0
+      self.freq = freq
+      clear
     end
     
     def freq= freq
@@ -20,22 +21,6 @@ module DSP
   end
   
   class ZDLP < OnePoleZD
-    attr_accessor :state
-    include Math
-    
-    def initialize
-      freq = srate / 2.0
-    end
-    
-    def freq= freq
-      @f    = tan( PI * freq * inv_srate )  # BLT... should be 2x oversampled
-      @finv = 1.0 / (1.0 + @f)
-    end
-
-    def clear 
-      @state = 0.0
-    end
-
     def tick input  # zero delay feedback
       output = (@state + @f * input ) * @finv;
       @state = @f * (input - output) + output
@@ -44,6 +29,17 @@ module DSP
       # output = @state + @f*iin
       # @state = @f * iin + output
     end
+
+    def ticks inputs
+      f, finv, state = @f, @finv, @state
+      out = inputs.map do |input|
+        output = (state + f * input) * finv
+        state  = f * (input - output) + output
+        output
+      end
+      @state = state
+      out
+    end
   end
 
   class ZDHP < OnePoleZD
@@ -123,6 +119,22 @@ module DSP
       end
     end
 
+    # process over a block with the coefficients and state in locals
+    def ticks inputs
+      return super if interpolating?
+      b0, b1, b2, a1, a2 = @b[0], @b[1], @b[2], @a[1], @a[2]
+      x1, x2, y1, y2 = @input[1], @input[2], @output[1], @output[2]
+      out = inputs.map do |x|
+        y  = b0*x + b1*x1 + b2*x2 - a1*y1 - a2*y2
+        x2 = x1
+        x1 = x + ANTI_DENORMAL
+        y2 = y1
+        y1 = y
+      end
+      @input[1], @input[2], @output[1], @output[2] = x1, x2, y1, y2
+      out
+    end
+
     def freq= arg
       @w0 = TWO_PI * arg * inv_srate # normalize freq [0,PI)
       recalc
@@ -210,10 +222,13 @@ module DSP
     
   # http://www.cytomic.com/files/dsp/SvfLinearTrapOptimised.pdf
   class SVF < Processor
+    include Math
     attr_accessor :kind, :freq
 
-    def initialize
-      @kind = :low
+    def initialize freq=1000.0, q=1.0/SQRT2
+      @kind = :lp
+      @freq, @q = freq, q
+      recalc
       clear
     end
 
@@ -225,7 +240,7 @@ module DSP
     end
     
     def freq= f
-      @freq = freq
+      @freq = f
       recalc
     end
 
@@ -260,11 +275,23 @@ module DSP
 
     def tick input
       process( input )
-      output[ @kind ]
+      @output[ @kind ]
     end
   end
   
   class BellSVF < SVF
+    attr_reader :dbGain
+
+    def initialize freq=1000.0, q=1.0/SQRT2, gain=0.0
+      @dbGain = gain
+      super freq, q
+    end
+
+    def dbGain= g
+      @dbGain = g
+      recalc
+    end
+
     def recalc
       @gb   = 10.0 ** (dbGain * 0.025)
       @g    = tan( PI * @freq * inv_srate )
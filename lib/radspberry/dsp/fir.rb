@@ -0,0 +1,199 @@
+module DSP
+
+  # direct-form FIR. the history is kept twice over (a doubled circular
+  # buffer) so the last taps.size inputs are always one contiguous run and
+  # each output is a single straight dot product, no wrap-around. blocks
+  # of ticks on filters longer than fft_threshold taps go through FFT
+  # overlap-save instead; the default threshold is the crossover measured
+  # by bench/fir.rb, and FIR.calibrate re-measures it on this machine.
+  #
+  #   lp = FIR.lowpass( 2000, 101 )          # windowed sinc, blackman
+  #   eq = FIR.least_squares( 63, [[0, 500], [1000, 22050]], [1.0, 0.25] )
+  #   Speaker[ GeneratorChain[ SuperSaw.new, lp ] ]
+  #
+  # design helpers make odd length symmetric (linear phase) filters,
+  # delayed by latency samples.
+  class FIR < Processor
+    class_attribute :fft_threshold
+    self.fft_threshold = 96  # bench/fir.rb, 4096 sample blocks
+
+    WINDOWS = {
+      :rectangular => lambda{ |x| 1.0 },
+      :hann        => lambda{ |x| 0.5 - 0.5 * ::Math.cos( 2 * PI * x ) },
+      :hamming     => lambda{ |x| 0.54 - 0.46 * ::Math.cos( 2 * PI * x ) },
+      :blackman    => lambda{ |x| 0.42 - 0.5 * ::Math.cos( 2 * PI * x ) + 0.08 * ::Math.cos( 4 * PI * x ) },
+    }
+
+    attr_reader :taps
+
+    def initialize taps
+      raise ArgumentError, "FIR needs at least one tap" if taps.empty?
+      @taps = taps.map(&:to_f)
+      @rev  = @taps.reverse  # oldest input first, to match the history
+      @n    = @taps.size
+      clear
+    end
+
+    def clear
+      @hist = Array.new( 2 * @n, 0.0 )
+      @pos  = @n - 1
+    end
+
+    def latency
+      (@n - 1) / 2
+    end
+
+    def tick input
+      n = @n
+      @pos = pos = (@pos + 1) % n
+      @hist[pos] = @hist[pos + n] = input
+      dot( @hist, pos + 1 )
+    end
+
+    def ticks inputs
+      return super if inputs.size < 2 || @n == 1
+      inputs = inputs.to_a
+      seq = @hist[@pos + 2, @n - 1] + inputs  # the last n-1 inputs, then the block
+      out = @n > fft_threshold ? fft_block( seq, inputs.size ) : direct_block( seq, inputs.size )
+      last = seq.last( @n )
+      @hist = last + last
+      @pos  = @n - 1
+      out
+    end
+
+    # magnitude response at freq
+    def response freq
+      w = 2 * PI * freq * inv_srate
+      re = im = 0.0
+      @taps.each_with_index{ |h,k| re += h * ::Math.cos( w * k ); im -= h * ::Math.sin( w * k ) }
+      ::Math.sqrt( re * re + im * im )
+    end
+
+    ## design
+
+    def self.window kind, n
+      w = WINDOWS.fetch( kind ){ raise ArgumentError, "unknown window #{kind}, choose from #{WINDOWS.keys}" }
+      n == 1 ? [1.0] : Array.new( n ){ |i| w.call( i.to_f / (n - 1) ) }
+    end
+
+    # windowed sinc lowpass, cutoff in Hz
+    def self.lowpass cutoff, n=101, window=:blackman
+      new( sinc_taps( cutoff, n, window ) )
+    end
+
+    # spectral inversion of the lowpass
+    def self.highpass cutoff, n=101, window=:blackman
+      taps = sinc_taps( cutoff, n, window ).map{ |h| -h }
+      taps[n / 2] += 1.0
+      new( taps )
+    end
+
+    def self.bandpass low, high, n=101, window=:blackman
+      new( sinc_taps( high, n, window ).zip( sinc_taps( low, n, window ) ).map{ |a,b| a - b } )
+    end
+
+    # least-squares linear phase design: bands are [from, to] pairs in Hz,
+    # gains (and optional weights) one per band. solves the normal equations
+    # for the cosine coefficients over a dense frequency grid
+    def self.least_squares n, bands, gains, weights=nil
+      raise ArgumentError, "least squares design needs an odd number of taps" if n.even?
+      weights ||= Array.new( bands.size, 1.0 )
+      m    = n / 2
+      grid = 16 * n
+      nyq  = Base.sampleRate / 2.0
+      q = Array.new( m + 1 ){ Array.new( m + 1, 0.0 ) }
+      d = Array.new( m + 1, 0.0 )
+      bands.each_with_index do |(from, to), b|
+        points = [(grid * (to - from) / nyq).ceil, 2].max
+        points.times do |p|
+          w = PI * (from + (to - from) * p / (points - 1.0)) / nyq
+          c = Array.new( m + 1 ){ |k| ::Math.cos( k * w ) }
+          c.each_with_index do |ck,k|
+            d[k] += weights[b] * gains[b] * ck
+            c.each_with_index{ |cj,j| q[k][j] += weights[b] * ck * cj }
+          end
+        end
+      end
+      a = Matrix[*q].lup.solve( Vector[*d] ).to_a  # A(w) = a0 + sum a_k cos(k w)
+      new( Array.new( n ){ |i| k = (i - m).abs; k == 0 ? a[0] : 0.5 * a[k] } )
+    end
+
+    def self.sinc_taps cutoff, n, window
+      fc  = cutoff.to_f / Base.sampleRate  # cycles per sample
+      mid = (n - 1) / 2.0
+      win = window( window, n )
+      taps = Array.new( n ){ |i| x = i - mid; win[i] * (x == 0 ? 2 * fc : ::Math.sin( 2 * PI * fc * x ) / (PI * x)) }
+      sum = taps.inject( :+ )
+      taps.map{ |h| h / sum }  # unity gain at dc
+    end
+
+    # times the direct and FFT paths for a range of lengths and sets
+    # fft_threshold to the first length where FFT wins. returns it
+    def self.calibrate block=4096, lengths=[16, 32, 48, 64, 96, 128, 192, 256, 384, 512]
+      input = Array.new( block ){ DSP.noise }
+      self.fft_threshold = lengths.find do |n|
+        f = new( Array.new( n ){ DSP.noise } )
+        direct = time{ f.send( :direct_block, f.instance_variable_get( :@hist )[0, n - 1] + input, block ) }
+        fft    = time{ f.send( :fft_block, f.instance_variable_get( :@hist )[0, n - 1] + input, block ) }
+        fft < direct
+      end || lengths.last
+    end
+
+    def self.time
+      t = Process.clock_gettime( Process::CLOCK_MONOTONIC )
+      yield
+      Process.clock_gettime( Process::CLOCK_MONOTONIC ) - t
+    end
+
+    private
+
+    def dot buf, offset
+      rev, n = @rev, @n
+      sum = 0.0
+      k = 0
+      while k < n
+        sum += rev[k] * buf[offset + k]
+        k += 1
+      end
+      sum
+    end
+
+    def direct_block seq, count
+      Array.new( count ){ |i| dot( seq, i ) }
+    end
+
+    # overlap-save: each transform yields size - n + 1 new outputs. the
+    # size is picked per block length for the least total work
+    def fft_block seq, count
+      n = @n
+      @ffts ||= {}
+      fft, hr, hi = @ffts[count] ||= begin
+        size = [1, 2, 4].map{ |m| m * FFT.size_for( 2 * n ) }.min_by{ |s| (count.to_f / (s - n + 1)).ceil * s * ::Math.log2( s ) }
+        [FFT[size], *FFT.spectrum( @taps, size )]
+      end
+      size = fft.size
+      hop = size - n + 1
+      out = []
+      pos = 0
+      while pos < count
+        len = [hop, count - pos].min
+        re  = seq[pos, n - 1 + len]
+        re.concat( Array.new( size - re.size, 0.0 ) )
+        im  = Array.new( size, 0.0 )
+        fft.forward( re, im )
+        k = 0
+        while k < size
+          r, i = re[k], im[k]
+          re[k] = r * hr[k] - i * hi[k]
+          im[k] = r * hi[k] + i * hr[k]
+          k += 1
+        end
+        fft.inverse( re, im )
+        out.concat( re[n - 1, len] )
+        pos += len
+      end
+      out
+    end
+  end
+
+end
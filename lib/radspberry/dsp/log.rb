@@ -0,0 +1,137 @@
+module DSP
+
+  # realtime-safe logging for the render and i/o paths.
+  # producers copy level, timestamp, format string and up to four args
+  # into a preallocated record in a RingBuffer; a background thread does
+  # the string formatting and the (blocking) writes. a full ring drops
+  # the message and the writer reports how many went missing.
+  #
+  # RingBuffer is single-producer, so every thread that logs gets its own
+  # ring on its first message (the audio callback, recorder writer, OSC
+  # thread and main script never share one). the writer merges them by
+  # timestamp.
+  #
+  #   Log.level = :debug   # or RADSPBERRY_LOG=debug in the environment
+  #   Log.info "wrote %d samples to %s", n, filename
+  module Log
+    extend self
+
+    LEVELS   = { :debug => 0, :info => 1, :warn => 2, :error => 3, :off => 4 }
+    CAPACITY = 1024   # records per producer thread
+    POLL     = 0.01   # seconds the writer sleeps when idle
+    NONE     = Object.new.freeze  # marks unused args, so nil can be logged
+
+    class Record < Struct.new( :level, :time, :message, :args )
+      def values
+        args.take_while{ |a| !NONE.equal?(a) }
+      end
+
+      def to_s
+        "%.6f [%s] %s" % [ time, level.to_s.upcase, message % values ]
+      rescue ArgumentError, TypeError
+        "%.6f [%s] %s %p" % [ time, level.to_s.upcase, message, values ]
+      end
+    end
+
+    @@io        = $stderr
+    @@rings     = {}          # producer thread => its ring
+    @@registry  = Mutex.new   # held only to add a ring or copy the list
+    @@writer    = nil
+    @@lock      = Mutex.new   # only between writer thread and flush, never producers
+    @@retired   = 0           # drops counted by rings of finished threads
+    @@reported  = 0
+
+    # registered when the file loads, ahead of the driver hooks, so it
+    # runs last and their closing messages still get written
+    at_exit{ flush }
+
+    def level
+      @@level
+    end
+
+    def level= lvl
+      lvl = lvl.to_sym
+      raise ArgumentError, "unknown log level #{lvl}, choose from #{LEVELS.keys}" unless LEVELS[lvl]
+      @@threshold = LEVELS[ @@level = lvl ]
+    end
+    self.level = ENV['RADSPBERRY_LOG'] || :warn
+
+    def io
+      @@io
+    end
+
+    def io= io
+      flush
+      @@io = io
+    end
+
+    def enabled? lvl
+      LEVELS[lvl] >= @@threshold
+    end
+
+    # no splat, so a call doesn't allocate an args array
+    def log lvl, message, a=NONE, b=NONE, c=NONE, d=NONE
+      return false unless enabled?( lvl )
+      start unless @@writer
+      ring.push do |r|
+        r.level, r.time, r.message = lvl, Process.clock_gettime( Process::CLOCK_MONOTONIC ), message
+        args = r.args
+        args[0], args[1], args[2], args[3] = a, b, c, d
+      end
+    end
+
+    LEVELS.each_key do |lvl|
+      next if lvl == :off
+      define_method( lvl ){ |message, a=NONE, b=NONE, c=NONE, d=NONE| log( lvl, message, a, b, c, d ) }
+    end
+
+    def dropped
+      @@registry.synchronize{ @@rings.each_value.inject( @@retired ){ |n, r| n + r.dropped } }
+    end
+
+    # blocks until everything queued so far has been written
+    def flush
+      @@lock.synchronize{ write_pending }
+    end
+
+    private
+
+    def ring
+      Thread.current.thread_variable_get( :radspberry_log ) || begin
+        r = RingBuffer.new( CAPACITY ){ Record.new( nil, nil, nil, Array.new(4, NONE) ) }
+        @@registry.synchronize{ @@rings[Thread.current] = r }
+        Thread.current.thread_variable_set( :radspberry_log, r )
+      end
+    end
+
+    def start
+      @@writer = Thread.new do
+        loop do
+          flush
+          sleep POLL
+        end
+      end
+    end
+
+    def write_pending
+      rings = @@registry.synchronize{ @@rings.to_a }
+      lines = []
+      rings.each do |thread, r|
+        finished = !thread.alive?  # checked first, so nothing can follow the drain
+        r.drain{ |rec| lines << [ rec.time, rec.to_s ] }
+        next unless finished
+        @@registry.synchronize{ @@rings.delete( thread ) }
+        @@retired += r.dropped
+      end
+      total = dropped
+      return if lines.empty? && total == @@reported
+      lines.sort_by!( &:first ).each{ |_, line| @@io.puts line }
+      if total > @@reported
+        @@io.puts "[log] #{total - @@reported} messages dropped"
+        @@reported = total
+      end
+      @@io.flush
+    end
+  end
+
+end
@@ -0,0 +1,120 @@
+module DSP
+
+  # routes modulation sources (any Generator: an LFO, an Envelope, another
+  # oscillator) to the parameters of a synth, by ParamMap path. every
+  # control period each source is rendered once, however many routes it
+  # feeds, and each destination gets either one value for the period or,
+  # if it takes audio rate input (param_accessor :audio_rate => true), a
+  # buffer of per-sample values.
+  #
+  #   mm = ModMatrix.new( XFader[ SuperSaw.new, RpmNoise.new ] )
+  #   mm.route LFO.new( 0.2, :tri ), "a.spread", :depth => 0.3
+  #   mm.route LFO.new( 6.0 ), "a.freq", :depth => 1.0/12, :curve => :exp  # vibrato, a semitone
+  #   mm.route Envelope.adsr( 0.5, 1, 0.5, 2 ).tap{ |e| e.trigger }, "fade"
+  #   Speaker[ mm ]
+  #
+  # a route adds depth * source to the parameter's base value (:linear) or
+  # multiplies it by 2**(depth * source) (:exp, depth in octaves); a curve
+  # can also be any callable taking (value, amount). routes to the same
+  # parameter apply in the order they were made. mm["a.spread"] = 0.5
+  # changes a base value.
+  class ModMatrix < Controller
+    Route = Struct.new( :source, :param, :depth, :curve )
+
+    CURVES = {
+      :linear => lambda{ |value, amount| value + amount },
+      :exp    => lambda{ |value, amount| value * 2.0 ** amount },
+    }
+
+    attr_reader :routes, :params
+
+    def initialize synth, kperiod=LFO::KPERIOD
+      super synth
+      @params  = ParamMap.new( synth )
+      @kperiod = kperiod
+      @routes  = []
+      @base    = {}  # path => unmodulated value
+      regroup
+    end
+
+    def route source, path, opts={}
+      opts  = opts.reverse_merge :depth => 1.0, :curve => :linear
+      param = @params[path] or raise ArgumentError, "no parameter #{path}, choose from #{@params.paths}"
+      curve = opts[:curve].respond_to?( :call ) ? opts[:curve] :
+        CURVES.fetch( opts[:curve] ){ raise ArgumentError, "unknown curve #{opts[:curve]}, choose from #{CURVES.keys}" }
+      @base[param.path] ||= param.get
+      @routes << Route.new( source, param, opts[:depth].to_f, curve )
+      regroup
+      @routes.last
+    end
+
+    # removes the routes to path and puts back its base value
+    def unroute path
+      param = @params[path] or return
+      @routes.reject!{ |r| r.param.equal?( param ) }
+      param.set( @base.delete( param.path ) ) if @base.key?( param.path )
+      regroup
+    end
+
+    def [] path
+      @base.fetch( path.to_s ){ @params[path].get }
+    end
+
+    def []= path, value
+      @base.key?( path.to_s ) ? @base[path.to_s] = value : @params[path].set( value )
+    end
+
+    def inputs
+      { "synth" => @synth }
+    end
+
+    def split samples
+      [samples, @kperiod].min
+    end
+
+    def control samples
+      audio = samples > 1
+      @sources.each do |src, buffered|
+        if buffered && audio
+          buf = @buffers[src] = src.ticks( samples ).to_a
+          @values[src] = buf[0]
+        elsif src.respond_to?( :advance )  # LFOs step once for the period
+          @values[src] = src.value
+          src.advance( samples )
+        else
+          @values[src] = src.ticks( samples ).to_a[0]
+        end
+      end
+      @dests.each do |param, routes, buffered|
+        base = @base[param.path]
+        if buffered && audio
+          param.target.send( param.buffer_setter, buffer( param, routes, base, samples ) )
+        else
+          param.set( routes.inject( base ){ |v,r| r.curve.call( v, r.depth * @values[r.source] ) } )
+        end
+      end
+    end
+
+    private
+
+    # sources and destinations, each once, and whether they run at audio rate
+    def regroup
+      @values  = {}.compare_by_identity
+      @buffers = {}.compare_by_identity
+      @dests   = @routes.group_by( &:param ).map{ |param, routes| [param, routes, param.audio_rate?] }
+      @sources = {}.compare_by_identity
+      @dests.each{ |param, routes, buffered| routes.each{ |r| @sources[r.source] ||= buffered } }
+    end
+
+    def buffer param, routes, base, samples
+      min, max = param.range ? [param.range.first.to_f, param.range.last.to_f] : [-Float::INFINITY, Float::INFINITY]
+      bufs = routes.map{ |r| @buffers[r.source] }
+      Array.new( samples ) do |i|
+        v = base
+        routes.each_with_index{ |r,k| v = r.curve.call( v, r.depth * bufs[k][i] ) }
+        v < min ? min : v > max ? max : v
+      end
+    end
+  end
+
+end
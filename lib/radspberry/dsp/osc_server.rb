@@ -0,0 +1,208 @@
+require 'socket'
+
+module DSP
+
+  # drives the parameters of a graph (see ParamMap) over OSC/UDP, for
+  # external sequencers and controllers. addresses are param paths with
+  # slashes, and may be patterns:
+  #
+  #   Speaker[ OscServer.new( XFader[ SuperSaw.new, RpmNoise.new ], 57120 ) ]
+  #   # oscsend localhost 57120 /a/spread f 0.8
+  #   # oscsend localhost 57120 /*/freq f 220
+  #
+  # a receiver thread decodes packets (bundles too) and fills preallocated
+  # events in a RingBuffer; the audio side copies them into a fixed pending
+  # table and applies each one at its sample, splitting the block there.
+  # bundle timetags are mapped to samples against the wall clock when they
+  # arrive; late or immediate ones apply at the start of the next block.
+  class OscServer < Controller
+    NTP_EPOCH = 2208988800   # 1900 -> 1970
+    IMMEDIATE = 1            # the "now" timetag
+    MAX_ROUTES = 1024        # cached pattern lookups
+
+    Event = Struct.new( :param, :value, :due )
+
+    attr_reader :map, :port, :clock, :received, :unknown
+
+    def initialize synth, port=57120, opts={}
+      super synth
+      opts = opts.reverse_merge :host => "127.0.0.1", :queue => 4096
+      @map     = opts[:map] || ParamMap.new( synth )
+      @params  = @map.to_a
+      @index   = Hash[ @params.each_with_index.map{ |p,i| ["/" + p.path.tr( ".", "/" ), i] } ]
+      @routes  = {}
+      @queue   = RingBuffer.new( opts[:queue] ){ Event.new }
+      @pending = Array.new( opts[:queue] ){ Event.new }
+      @npending = 0
+      @clock = @received = @unknown = 0
+      @socket = UDPSocket.new
+      @socket.bind( opts[:host], port )
+      @port = @socket.addr[1]
+      @thread = Thread.new{ serve }
+    end
+
+    # events lost because the audio side wasn't draining fast enough
+    def dropped
+      @queue.dropped
+    end
+
+    # queues a change of the param at path; due is an absolute sample
+    # (see #clock), nil for the next block. called by the receiver thread
+    def schedule path, value, due=nil
+      return @unknown += 1 unless (ids = route( path ))
+      ids.each do |i|
+        @queue.push{ |e| e.param = i; e.value = value; e.due = due || 0 }
+      end
+    end
+
+    def split samples
+      fetch
+      nxt = @clock + samples
+      @npending.times{ |i| due = @pending[i].due; nxt = due if due > @clock && due < nxt }
+      nxt - @clock
+    end
+
+    def control samples
+      fetch
+      i = 0
+      while i < @npending
+        e = @pending[i]
+        if e.due <= @clock
+          @params[e.param].set( e.value )
+          @npending -= 1
+          @pending[i], @pending[@npending] = @pending[@npending], e  # swap out, keep the slot
+        else
+          i += 1
+        end
+      end
+      @clock += samples
+    end
+
+    def close
+      @thread.kill
+      @socket.close
+    end
+
+    def self.parse packet, &block
+      Packet.new( packet ).each( &block )
+    end
+
+    private
+
+    # moves what the receiver queued into the pending table
+    def fetch
+      until @queue.empty? || @npending == @pending.size
+        @queue.pop do |src|
+          dst = @pending[@npending]
+          dst.param, dst.value, dst.due = src.param, src.value, src.due
+          @npending += 1
+        end
+      end
+    end
+
+    def route address
+      @routes.fetch( address ) do
+        ids = @index[address] ? [@index[address]] : @index.select{ |a,_| OscServer.match?( address, a ) }.values
+        @routes.clear if @routes.size >= MAX_ROUTES
+        @routes[address] = ids.empty? ? nil : ids
+      end
+    end
+
+    def self.match? pattern, address
+      File.fnmatch( pattern, address, File::FNM_PATHNAME | File::FNM_EXTGLOB )
+    end
+
+    def serve
+      loop do
+        packet = @socket.recv( 65536 )
+        @received += 1
+        begin
+          OscServer.parse( packet ){ |address, value, time| schedule( address, value, due_at( time ) ) }
+        rescue StandardError => e  # one bad datagram mustn't stop the receiver
+          Log.warn "bad OSC packet: %s", e.message
+        end
+      end
+    rescue IOError
+    end
+
+    def due_at time
+      return nil if time == IMMEDIATE
+      delay = (time.to_f / 2**32 - NTP_EPOCH) - Time.now.to_f
+      delay > 0 ? @clock + (delay * @synth.srate).round : nil
+    end
+
+    # OSC 1.0 decoding: yields address, first numeric argument and the
+    # enclosing bundle's timetag for every message in a packet
+    class Packet
+      BUNDLE = "#bundle\0"
+
+      def initialize data
+        @data = data
+      end
+
+      def each &block
+        element( 0, @data.bytesize, IMMEDIATE, &block )
+      end
+
+      private
+
+      def element pos, stop, time, &block
+        if @data.byteslice( pos, 8 ) == BUNDLE
+          hi, lo = field( pos + 8, 8, stop ).unpack( "NN" )
+          time = (hi << 32) | lo
+          pos += 16
+          while pos < stop
+            size = field( pos, 4, stop ).unpack1( "N" )
+            raise ArgumentError, "truncated bundle" if pos + 4 + size > stop
+            element( pos + 4, pos + 4 + size, time, &block )
+            pos += 4 + size
+          end
+        else
+          message( pos, stop, time, &block )
+        end
+      end
+
+      def message pos, stop, time
+        address, pos = string( pos, stop )
+        raise ArgumentError, "bad address #{address.inspect}" unless address.start_with?( "/" )
+        tags, pos = string( pos, stop ) if pos < stop
+        value = nil
+        (tags || ",")[1..-1].each_char do |tag|
+          case tag
+          when "f" then value ||= field( pos, 4, stop ).unpack1( "g" ); pos += 4
+          when "i" then value ||= field( pos, 4, stop ).unpack1( "l>" ); pos += 4
+          when "d" then value ||= field( pos, 8, stop ).unpack1( "G" ); pos += 8
+          when "h" then value ||= field( pos, 8, stop ).unpack1( "q>" ); pos += 8
+          when "T" then value ||= 1
+          when "F" then value ||= 0
+          when "s", "S" then _, pos = string( pos, stop )
+          when "b"
+            size = field( pos, 4, stop ).unpack1( "N" )
+            field( pos + 4, size, stop )
+            pos += 4 + pad( size )
+          when "N", "I" then nil
+          else raise ArgumentError, "unsupported OSC type tag #{tag}"
+          end
+        end
+        yield address, value, time unless value.nil?
+      end
+
+      def string pos, stop
+        nul = @data.index( "\0", pos )
+        raise ArgumentError, "unterminated OSC string" unless nul && nul < stop
+        [ @data.byteslice( pos, nul - pos ), pos + pad( nul - pos + 1 ) ]
+      end
+
+      # the n bytes at pos, which have to end by stop
+      def field pos, n, stop
+        raise ArgumentError, "truncated OSC packet" if pos + n > stop
+        @data.byteslice( pos, n )
+      end
+
+      def pad n
+        (n + 3) & ~3
+      end
+    end
+  end
+
+end
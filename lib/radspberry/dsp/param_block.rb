@@ -0,0 +1,118 @@
+module DSP
+
+  # exposes the parameters of a graph (see ParamMap) as float64 slots in a
+  # SharedMemory block, so local GUIs and other processes can drive them
+  # by writing memory: no messages to parse, no calls into this process.
+  # the engine checks a version counter once per block and only calls the
+  # setters of values that actually changed.
+  #
+  #   Speaker[ ParamBlock.new( SuperSaw.new, "saw" ) ]
+  #   # in another process:
+  #   ctl = ParamBlock.connect( "saw" )
+  #   ctl["spread"] = 0.9
+  #   ctl.update "spread" => 0.2, "mix" => 0.5  # one version bump for both
+  #
+  # layout: 64 byte header (magic, count, version), count 64 byte entries
+  # (name, min, max), count float64 values. the version is a seqlock: odd
+  # while a writer is busy, so the engine never applies a torn update.
+  # there should be one writing process at a time.
+  class ParamBlock < Controller
+    MAGIC   = "RSPPARM1"
+    HEADER  = 64
+    ENTRY   = 64
+    VERSION = 16  # header offset of the seqlock counter
+
+    attr_reader :map, :name
+
+    def initialize synth, name, map=nil
+      super synth
+      @name   = name
+      @map    = map || ParamMap.new( synth )
+      yield @map if block_given?
+      @params = @map.to_a
+      @count  = @params.size
+      @values_at = HEADER + @count * ENTRY
+      @applied   = @params.map{ |p| (p.get || 0).to_f }
+
+      @mem = SharedMemory.new( name, @values_at + 8 * @count )
+      @mem.write( 0, [MAGIC, @count].pack( "a8V" ) )
+      @params.each_with_index do |p,i|
+        min, max = p.range ? [p.range.first, p.range.last] : [-Float::INFINITY, Float::INFINITY]
+        @mem.write( HEADER + i * ENTRY, [p.path, min, max].pack( "a48EE" ) )
+      end
+      @mem.write( @values_at, @applied.pack( "E*" ) )
+      @mem.put_u64( VERSION, @seen = 0 )
+    end
+
+    def self.connect name
+      Client.new( name )
+    end
+
+    def control samples
+      version = @mem.get_u64( VERSION )
+      return if version == @seen || version.odd?
+      values = @mem.read( @values_at, 8 * @count ).unpack( "E*" )
+      return unless @mem.get_u64( VERSION ) == version  # torn, pick it up next block
+      @seen = version
+      values.each_with_index do |v,i|
+        next if v == @applied[i]
+        @params[i].set( @applied[i] = v )
+      end
+    end
+
+    def close
+      @mem.close
+    end
+
+    def unlink
+      @mem.unlink
+    end
+
+    # the external side
+    class Client
+      attr_reader :paths
+
+      def initialize name
+        @mem = SharedMemory.new( name )
+        magic, count = @mem.read( 0, 12 ).unpack( "a8V" )
+        raise ArgumentError, "#{@mem.path} is not a radspberry parameter block" unless magic == MAGIC
+        @values_at = HEADER + count * ENTRY
+        @index  = {}
+        @ranges = {}
+        count.times do |i|
+          path, min, max = @mem.read( HEADER + i * ENTRY, ENTRY ).unpack( "Z48EE" )
+          @index[path]  = i
+          @ranges[path] = min..max
+        end
+        @paths = @index.keys
+      end
+
+      def range path
+        @ranges.fetch( path )
+      end
+
+      def [] path
+        @mem.read( @values_at + 8 * @index.fetch( path ), 8 ).unpack( "E" )[0]
+      end
+
+      def []= path, value
+        update( path => value )
+      end
+
+      # paths are looked up first, so an unknown one can't leave the
+      # version odd and lock the engine out
+      def update values
+        slots = values.map{ |path,v| [@values_at + 8 * @index.fetch( path ), [v.to_f].pack( "E" )] }
+        version = @mem.get_u64( VERSION )
+        @mem.put_u64( VERSION, version + 1 )
+        slots.each{ |offset,bytes| @mem.write( offset, bytes ) }
+        @mem.put_u64( VERSION, version + 2 )
+      end
+
+      def close
+        @mem.close
+      end
+    end
+  end
+
+end
@@ -0,0 +1,79 @@
+module DSP
+
+  # the parameters of a graph by dotted path, e.g. "a.spread" for the
+  # spread of an XFader's first input. found by following each node's
+  # inputs and asking its class for param_names; anything else (a plain
+  # attr_accessor, an internal node) can be added by hand.
+  #
+  #   map = ParamMap.new( XFader[ SuperSaw.new, RpmNoise.new ] )
+  #   map.paths     # => ["fade", "a.freq", "a.spread", "a.mix", "b.phase", "b.freq"]
+  #   map["a.spread"].set 0.9
+  class ParamMap
+    include Enumerable
+
+    class Param < Struct.new( :path, :target, :name, :range )
+      def setter
+        @setter ||= :"#{name}="
+      end
+
+      def get
+        target.send( name )
+      end
+
+      def set value
+        target.send( setter, value )
+      end
+
+      # whether the target takes a buffer of per-sample values (declared
+      # with param_accessor :audio_rate => true)
+      def audio_rate?
+        target.respond_to?( buffer_setter )
+      end
+
+      def buffer_setter
+        @buffer_setter ||= :"#{name}_buffer="
+      end
+    end
+
+    def initialize graph=nil
+      @params = {}
+      add_graph( graph ) if graph
+    end
+
+    def add path, target, name, range=nil
+      @params[path.to_s] = Param.new( path.to_s, target, name.to_sym, range )
+    end
+
+    def add_graph obj, prefix=nil, seen={}.compare_by_identity
+      return self if seen[obj]
+      seen[obj] = true
+      return add_graph( obj.synth, prefix, seen ) if obj.is_a?( Controller )
+      obj.class.param_ranges.each{ |name, range| add( join(prefix, name), obj, name, range ) }
+      obj.inputs.each{ |name, input| add_graph( input, join(prefix, name), seen ) } if obj.respond_to?( :inputs )
+      self
+    end
+
+    def [] path
+      @params[path.to_s]
+    end
+
+    def paths
+      @params.keys
+    end
+
+    def size
+      @params.size
+    end
+
+    def each &block
+      @params.each_value( &block )
+    end
+
+    private
+
+    def join prefix, name
+      prefix ? "#{prefix}.#{name}" : name.to_s
+    end
+  end
+
+end
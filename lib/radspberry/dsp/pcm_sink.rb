@@ -0,0 +1,72 @@
+module DSP
+
+  # renders a generator block by block as raw PCM into an IO: stdout, a
+  # pipe, a socket. only one block is ever in flight, so a slow reader
+  # just makes the write block (backpressure) instead of piling up memory.
+  # runs as fast as the reader allows, or paced to the wall clock with
+  # :realtime => true.
+  #
+  #   PcmSink.new( SuperSaw.new, $stdout, :format => :int16 ).run( 60 )
+  #   ruby synth.rb | sox -t raw -r 44100 -e signed -b 16 -c 1 - out.flac
+  class PcmSink
+    FORMATS = { :float32 => "e*", :int16 => "s<*" }
+
+    attr_reader :frames_written, :bytes_written, :elapsed
+
+    def initialize gen, io=$stdout, opts={}
+      opts = opts.reverse_merge :format => :float32, :frameSize => 1024, :realtime => false
+      raise ArgumentError, "unknown format #{opts[:format]}, choose from #{FORMATS.keys}" unless FORMATS[ opts[:format] ]
+      raise ArgumentError, "#{gen.class} doesn't respond to ticks!" unless gen.respond_to?(:ticks)
+      @gen, @io = gen, io
+      @format, @frameSize, @realtime = opts[:format], opts[:frameSize], opts[:realtime]
+      @io.binmode
+      @io.sync = true  # hand each block straight to the OS
+      @frames_written = @bytes_written = 0
+      @elapsed = 0.0
+    end
+
+    # renders seconds of audio, or until the reader goes away when nil
+    def run seconds=nil
+      total = seconds && (@gen.srate * seconds).to_i
+      start = now
+      until total && @frames_written >= total
+        frames = total ? [@frameSize, total - @frames_written].min : @frameSize
+        @bytes_written += @io.write( pack( @gen.ticks( frames ).to_a ) )
+        @frames_written += frames
+        pace( start ) if @realtime
+      end
+      self
+    rescue Errno::EPIPE, IOError  # reader closed the pipe
+      self
+    ensure
+      @elapsed = now - start
+      Log.info "%s: %d frames in %.2fs (%.1fx realtime)", self.class, @frames_written, @elapsed, realtime_factor
+    end
+
+    def frames_per_second
+      @elapsed > 0 ? @frames_written / @elapsed : 0.0
+    end
+
+    def realtime_factor
+      frames_per_second / @gen.srate
+    end
+
+    private
+
+    def now
+      Process.clock_gettime( Process::CLOCK_MONOTONIC )
+    end
+
+    # sleeps until the wall clock catches up with what was rendered
+    def pace start
+      ahead = start + @frames_written.to_f / @gen.srate - now
+      sleep ahead if ahead > 0
+    end
+
+    def pack data
+      return data.pack( FORMATS[:float32] ) if @format == :float32
+      data.map{ |d| d > 1.0 ? 32767 : d < -1.0 ? -32767 : (d * 32767).round }.pack( FORMATS[:int16] )
+    end
+  end
+
+end
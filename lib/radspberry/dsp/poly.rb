@@ -0,0 +1,81 @@
+module DSP
+
+  # a pool of voices, each a synth from the block behind a VCA, played by
+  # channel and note. a note takes a voice already on it, else an idle one,
+  # else steals the one started longest ago. idle voices aren't rendered.
+  # Sequencer calls note_on / note_off, so it can play a Poly as is.
+  #
+  #   poly = Poly.new( 8, [0.01, 0.3, 0.6, 0.5] ){ SuperSaw.new }
+  #   poly.note_on 60, 100      # channel 0
+  #   poly.note_on 60, 90, 9    # the same note on channel 9 gets its own voice
+  #   poly.note_off 60
+  class Poly < Generator
+    attr_reader :voices
+    attr_accessor :gain
+
+    def initialize count=8, adsr=[0.005, 0.1, 0.8, 0.2], gain=1.0, &build
+      raise ArgumentError, "pass a block that builds a voice" unless build
+      @voices   = Array.new( count ){ VCA.new( build.call, Envelope.adsr( *adsr ) ) }
+      @notes    = Array.new( count )     # note each voice is on, nil once released
+      @channels = Array.new( count )     # and its channel
+      @started  = Array.new( count, 0 )  # note_on count when each voice started
+      @count    = 0
+      @gain     = gain
+    end
+
+    def note_on note, velocity=100, channel=0
+      i = playing( note, channel ) || @voices.index{ |v| v.env.idle? } || @started.each_with_index.min[1]
+      voice = @voices[i]
+      voice.freq = MIDI::note_to_freq( note )
+      voice.env.trigger( velocity / 127.0 )
+      @notes[i], @channels[i] = note, channel
+      @started[i] = @count += 1
+    end
+
+    def note_off note, channel=0
+      @notes.each_index do |i|
+        next unless @notes[i] == note && @channels[i] == channel
+        @voices[i].env.release
+        @notes[i] = nil
+      end
+    end
+
+    def all_notes_off
+      @notes.each_index{ |i| note_off( @notes[i], @channels[i] ) if @notes[i] }
+    end
+
+    def active
+      @voices.count{ |v| !v.env.idle? }
+    end
+
+    def tick
+      @voices.inject( 0.0 ){ |sum,v| v.env.idle? ? sum : sum + v.tick } * @gain
+    end
+
+    def ticks samples
+      out = nil
+      @voices.each do |v|
+        next if v.env.idle?
+        buf = v.ticks( samples ).to_a
+        if out
+          i = 0
+          while i < samples
+            out[i] += buf[i]
+            i += 1
+          end
+        else
+          out = buf
+        end
+      end
+      return Vector.zeros( samples ) unless out
+      (@gain == 1.0 ? out : out.map{ |s| s * @gain }).to_v
+    end
+
+    private
+
+    def playing note, channel
+      @notes.each_index.find{ |i| @notes[i] == note && @channels[i] == channel }
+    end
+  end
+
+end
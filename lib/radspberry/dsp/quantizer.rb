@@ -0,0 +1,81 @@
+module DSP
+
+  # float to integer PCM, a block at a time: scale, TPDF dither, optional
+  # noise shaping, clip and round. the dither comes from two Random#bytes
+  # calls per block (two 16 bit uniforms per sample, summed), which costs far
+  # less than a rand per sample. shaping feeds the rounding error back
+  # through (1 - z^-1)^2, pushing the noise floor up towards nyquist.
+  #
+  #   q = Quantizer.new( 16, :shape => true )
+  #   q.pack( block )  # => little endian 16 bit bytes for a wav
+  #
+  # keeps its error history (per channel, for interleaved blocks) between
+  # blocks, so use one per stream.
+  class Quantizer
+    PACK = { 16 => "s<*", 24 => "l<*", 32 => "l<*" }
+    TPDF_SCALE = 1.0 / 65536  # two uniforms in 0...65536 -> -1...1 lsb
+
+    attr_reader :bits, :clipped
+
+    def initialize bits=16, opts={}
+      opts = opts.reverse_merge :dither => true, :shape => false, :gain => 1.0, :seed => nil, :channels => 1
+      raise ArgumentError, "unsupported bit depth #{bits}, choose from #{PACK.keys}" unless PACK[bits]
+      @bits, @dither, @shape = bits, opts[:dither], opts[:shape]
+      @max   = 2 ** (bits - 1) - 1
+      @min   = -@max - 1
+      @scale = @max * opts[:gain]
+      @rng   = opts[:seed] ? Random.new( opts[:seed] ) : Random.new
+      @channels = opts[:channels]
+      @e1 = Array.new( @channels, 0.0 )
+      @e2 = Array.new( @channels, 0.0 )
+      @clipped = 0
+    end
+
+    def gain= g
+      @scale = @max * g
+    end
+
+    # integer sample values for a block of floats
+    def convert samples
+      n = samples.size
+      if @dither  # two uniform blocks, summed inline: no noise array
+        u1 = @rng.bytes( 2 * n ).unpack( "S*" )
+        u2 = @rng.bytes( 2 * n ).unpack( "S*" )
+      end
+      max, min, scale = @max, @min, @scale
+      if @shape
+        e1, e2, ch = @e1, @e2, @channels
+        Array.new( n ) do |i|
+          c = i % ch
+          v = samples[i] * scale - 2.0 * e1[c] + e2[c]  # error feedback, (1 - z^-1)^2
+          q = (u1 ? v + (u1[i] + u2[i]) * TPDF_SCALE - 1.0 : v).round
+          e2[c] = e1[c]
+          e1[c] = q - v  # before clipping, so a clipped peak can't wind the loop up
+          q > max ? (@clipped += 1; max) : q < min ? (@clipped += 1; min) : q
+        end
+      elsif u1
+        Array.new( n ) do |i|
+          q = (samples[i] * scale + (u1[i] + u2[i]) * TPDF_SCALE - 1.0).round
+          q > max ? (@clipped += 1; max) : q < min ? (@clipped += 1; min) : q
+        end
+      else
+        samples.map do |s|
+          q = (s * scale).round
+          q > max ? (@clipped += 1; max) : q < min ? (@clipped += 1; min) : q
+        end
+      end
+    end
+
+    # converted and packed little endian, ready for a wav data chunk
+    def pack samples
+      bytes = convert( samples ).pack( PACK[@bits] )
+      @bits == 24 ? Quantizer.narrow24( bytes ) : bytes
+    end
+
+    # drops the top byte of each little endian int32
+    def self.narrow24 bytes
+      bytes.unpack( "a3x" * (bytes.bytesize / 4) ).join
+    end
+  end
+
+end
@@ -0,0 +1,96 @@
+module DSP
+
+  # records exactly what an AudioStream plays into a wav file.
+  # the audio callback only copies each block into a preallocated ring
+  # slot; a writer thread packs the samples and does the disk i/o.
+  # the header is rewritten every few blocks, so the file stays readable
+  # even if the process dies mid-record. with :peaks => true the writer
+  # also builds a PeakFile sidecar as it goes.
+  #
+  #   Speaker.record "take1.wav", :format => :pcm16, :peaks => true
+  #   Speaker.stop_recording
+  class Recorder
+    FORMATS = {  # bit depth, wav format tag
+      :float => [ 32, RiffFile::FORMAT_FLOAT ],
+      :pcm16 => [ 16, RiffFile::FORMAT_PCM   ],
+      :pcm24 => [ 24, RiffFile::FORMAT_PCM   ],
+    }
+    POLL = 0.005 # seconds the writer sleeps when the ring is empty
+
+    # one hook for all of them: recordings still running at exit get finished
+    @@live = []
+    at_exit{ @@live.dup.each( &:stop ) }
+
+    attr_reader :filename, :frames_written, :blocks_written
+
+    def initialize filename, opts={}
+      opts = opts.reverse_merge :format => :float, :channels => 1, :blocks => 64,
+                                :frameSize => 2**12, :srate => Base.sampleRate, :flush_every => 8, :peaks => false,
+                                :dither => true, :shape => false
+      raise ArgumentError, "unknown format #{opts[:format]}" unless FORMATS[ opts[:format] ]
+      @filename = filename
+      @bit_depth, @audio_format = FORMATS[ opts[:format] ]
+      @flush_every = opts[:flush_every]
+      @channels    = opts[:channels]
+      @frames_written = @blocks_written = 0
+
+      @ring = RingBuffer.new( opts[:blocks] ){ Array.new( opts[:frameSize], 0.0 ) }
+      @wav  = RiffFile.new( filename, "wb+" )
+      @wav.begin_data( opts[:channels], opts[:srate].to_i, @bit_depth, @audio_format )
+      @quantizer = Quantizer.new( @bit_depth, :channels => @channels, :dither => opts[:dither], :shape => opts[:shape] ) unless @audio_format == RiffFile::FORMAT_FLOAT
+      @peaks = PeakFile.new( PeakFile.sidecar( filename ), opts[:channels], opts[:srate] ) if opts[:peaks]
+
+      @running = true
+      @writer  = Thread.new{ write_loop }
+      @@live << self
+    end
+
+    # realtime side: copies the block into a ring slot, never blocks
+    def << block
+      @ring.push{ |slot| slot.replace( block ) }
+      self
+    end
+
+    def dropped
+      @ring.dropped
+    end
+
+    def recording?
+      @running
+    end
+
+    def stop
+      return self unless @running
+      @running = false
+      @writer.join
+      @@live.delete( self )
+      self
+    end
+
+    private
+
+    def write_loop
+      while @running || !@ring.empty?
+        if @ring.empty?
+          sleep POLL
+          next
+        end
+        @ring.pop do |block|
+          @wav.append_data( pack(block) )
+          @peaks << block if @peaks
+          @frames_written += block.size / @channels
+        end
+        @wav.update_sizes if (@blocks_written += 1) % @flush_every == 0
+      end
+      @wav.finish_data
+      @wav.close
+      @peaks.finish if @peaks
+      Log.warn "%s: %d blocks dropped", @filename, dropped if dropped > 0
+    end
+
+    def pack block
+      @quantizer ? @quantizer.pack( block ) : @wav.pack_samples( block, @bit_depth, @audio_format )
+    end
+  end
+
+end
@@ -0,0 +1,62 @@
+module DSP
+
+  # single-producer / single-consumer ring of preallocated slots.
+  # the producer only ever advances @write and the consumer only @read,
+  # so neither side needs a lock and the producer never waits: if the
+  # ring is full the item is dropped and counted instead.
+  class RingBuffer
+    attr_reader :capacity, :dropped
+
+    def initialize capacity
+      @capacity = capacity
+      @slots    = Array.new( capacity ){ block_given? ? yield : nil }
+      @read = @write = 0
+      @dropped = 0
+    end
+
+    def size
+      @write - @read
+    end
+
+    def empty?
+      @write == @read
+    end
+
+    def full?
+      size >= @capacity
+    end
+
+    # with a block, fills the next slot in place (no allocation);
+    # otherwise stores item in it. returns false when dropped
+    def push item=nil
+      if full?
+        @dropped += 1
+        return false
+      end
+      idx = @write % @capacity
+      if block_given?
+        yield @slots[idx]
+      else
+        @slots[idx] = item
+      end
+      @write += 1  # publish only after the slot is filled
+      true
+    end
+    alias << push
+
+    # yields the oldest slot and releases it afterwards, so the producer
+    # can't overwrite it while it is being read. returns nil when empty
+    def pop
+      return nil if empty?
+      item = @slots[ @read % @capacity ]
+      result = block_given? ? yield( item ) : item
+      @read += 1
+      result
+    end
+
+    def drain
+      pop{|item| yield item } until empty?
+    end
+  end
+
+end
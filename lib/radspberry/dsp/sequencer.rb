@@ -0,0 +1,182 @@
+module DSP
+
+  # plays timed events against a synth to the sample: notes, parameter
+  # changes, graph swaps and plain blocks. pending events sit in a binary
+  # heap keyed by sample time (parallel arrays, grown by doubling, so tens
+  # of thousands cost log n each); before rendering, everything due is
+  # popped and the block is split at the next event.
+  #
+  #   seq = Sequencer.new( VCA.new( SuperSaw.new ) )
+  #   [60, 64, 67, 72].each_with_index{ |n,i| seq.note( i * 0.25, n, 100, 0.2 ) }
+  #   seq.set( 1.0, "spread", 0.9 )
+  #   seq.at( 2.0 ){ |synth| synth.clear }
+  #   seq.swap( 4.0, VCA.new( RpmSaw.new ) )
+  #   Speaker[ seq ]   # or seq.to_wav( 5 )
+  #
+  # times are seconds from the start of rendering. the thread that renders
+  # (and anything before rendering starts) schedules straight into the
+  # heap; other threads go through a RingBuffer the audio side drains.
+  #
+  # notes call note_on( note, velocity ) / note_off( note ) on the synth if
+  # it has them (with the channel as a last argument, when one was given),
+  # otherwise set freq and trigger / release its env (a VCA).
+  class Sequencer < Controller
+    Event = Struct.new( :time, :kind, :target, :value, :channel )
+
+    attr_reader :pos
+
+    def initialize synth, opts={}
+      super synth
+      opts = opts.reverse_merge :capacity => 1024, :queue => 4096
+      @keys   = Array.new( opts[:capacity] )  # time << 32 | order, so ties keep their order
+      @events = Array.new( opts[:capacity] )
+      @size   = 0
+      @order  = 0
+      @pos    = 0
+      @inbox  = RingBuffer.new( opts[:queue] ){ Event.new }
+    end
+
+    def pending
+      @size + @inbox.size
+    end
+
+    # events from other threads that didn't fit in the inbox
+    def dropped
+      @inbox.dropped
+    end
+
+    def position
+      @pos * Base.inv_srate
+    end
+
+    ## scheduling
+
+    def at seconds, &block
+      schedule( seconds, :call, block )
+    end
+
+    def set seconds, path, value
+      schedule( seconds, :set, path.to_s, value )
+    end
+
+    def note seconds, note, velocity=100, length=nil, channel=nil
+      schedule( seconds, :note_on, note, velocity, channel )
+      schedule( seconds + length, :note_off, note, nil, channel ) if length
+    end
+
+    def note_off seconds, note, channel=nil
+      schedule( seconds, :note_off, note, nil, channel )
+    end
+
+    def swap seconds, synth
+      schedule( seconds, :swap, synth )
+    end
+
+    # negative times are due at once: they'd break the heap keys
+    def schedule seconds, kind, target=nil, value=nil, channel=nil
+      time = [(seconds * Base.sampleRate).round, 0].max
+      if @renderer.nil? || Thread.current.equal?( @renderer )
+        insert( Event.new( time, kind, target, value, channel ) )
+      else
+        @inbox.push{ |e| e.time = time; e.kind = kind; e.target = target; e.value = value; e.channel = channel }
+      end
+    end
+
+    def clear
+      @events.fill( nil, 0, @size )  # don't keep blocks and synths alive
+      @size = 0
+      @inbox.drain{}
+      super
+    end
+
+    ## rendering
+
+    def tick
+      split( 1 )
+      control( 1 )
+      @synth.tick
+    end
+
+    # fires what is due and returns the distance to the next event
+    def split samples
+      @renderer ||= Thread.current
+      @inbox.drain{ |e| insert( e.dup ) } unless @inbox.empty?
+      fire( pop ) while @size > 0 && (@keys[0] >> 32) <= @pos
+      @size > 0 ? [(@keys[0] >> 32) - @pos, samples].min : samples
+    end
+
+    def control samples
+      @pos += samples
+    end
+
+    private
+
+    def fire e
+      case e.kind
+      when :call     then e.target.call( @synth )
+      when :set      then (p = params[e.target]) ? p.set( e.value ) : Log.warn( "sequencer: no parameter %s", e.target )
+      when :note_on  then note_on( e.target, e.value, e.channel )
+      when :note_off then note_off_now( e.target, e.channel )
+      when :swap     then @synth = e.target; @params = nil
+      end
+    end
+
+    def params
+      @params ||= ParamMap.new( @synth )
+    end
+
+    def note_on note, velocity, channel
+      if @synth.respond_to?( :note_on )
+        return channel ? @synth.note_on( note, velocity, channel ) : @synth.note_on( note, velocity )
+      end
+      @synth.freq = MIDI::note_to_freq( note )
+      @synth.env.trigger( velocity / 127.0 ) if @synth.respond_to?( :env )
+      @note = note
+    end
+
+    def note_off_now note, channel
+      if @synth.respond_to?( :note_off )
+        return channel ? @synth.note_off( note, channel ) : @synth.note_off( note )
+      end
+      @synth.env.release if note == @note && @synth.respond_to?( :env )
+    end
+
+    ## binary heap on @keys / @events
+
+    def insert event
+      if @size == @keys.size
+        @keys.concat( Array.new( @size ) )
+        @events.concat( Array.new( @size ) )
+      end
+      key = event.time << 32 | (@order = (@order + 1) & 0xffffffff)
+      keys, events = @keys, @events
+      i = @size
+      @size += 1
+      while i > 0
+        parent = (i - 1) >> 1
+        break if keys[parent] <= key
+        keys[i], events[i] = keys[parent], events[parent]
+        i = parent
+      end
+      keys[i], events[i] = key, event
+    end
+
+    def pop
+      keys, events = @keys, @events
+      top = events[0]
+      @size -= 1
+      key, event = keys[@size], events[@size]
+      events[@size] = nil
+      i, n = 0, @size
+      while (child = 2 * i + 1) < n
+        child += 1 if child + 1 < n && keys[child + 1] < keys[child]
+        break if key <= keys[child]
+        keys[i], events[i] = keys[child], events[child]
+        i = child
+      end
+      keys[i], events[i] = key, event if n > 0
+      top
+    end
+  end
+
+end
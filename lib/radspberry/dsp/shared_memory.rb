@@ -0,0 +1,104 @@
+require 'tmpdir'
+
+module DSP
+
+  # a named block of memory shared between local processes: a file under
+  # /dev/shm (the tmpdir where there is none) mapped MAP_SHARED with mmap
+  # through Fiddle. if mapping isn't possible it falls back to pread and
+  # pwrite on the same file, which on /dev/shm still never touches a disk.
+  #
+  #   mem = SharedMemory.new( "params", 4096 )  # creates if needed
+  #   mem.put_u64( 0, 42 )
+  #   SharedMemory.new( "params" ).get_u64( 0 )  # => 42, from another process
+  class SharedMemory
+    DIR = File.directory?( "/dev/shm" ) ? "/dev/shm" : Dir.tmpdir
+
+    module Mmap  # :nodoc:
+      PROT_READ, PROT_RW, MAP_SHARED = 1, 3, 1
+      begin
+        require 'fiddle'
+        libc    = Fiddle.dlopen( nil )
+        MMAP    = Fiddle::Function.new( libc['mmap'], [Fiddle::TYPE_VOIDP, Fiddle::TYPE_SIZE_T, Fiddle::TYPE_INT,
+                                        Fiddle::TYPE_INT, Fiddle::TYPE_INT, Fiddle::TYPE_LONG], Fiddle::TYPE_VOIDP )
+        MUNMAP  = Fiddle::Function.new( libc['munmap'], [Fiddle::TYPE_VOIDP, Fiddle::TYPE_SIZE_T], Fiddle::TYPE_INT )
+        FAILED  = (1 << (8 * Fiddle::SIZEOF_VOIDP)) - 1
+      rescue LoadError, Fiddle::DLError
+        MMAP = nil
+      end
+
+      def self.map file, size, prot=PROT_RW
+        return nil unless MMAP && size > 0
+        ptr = MMAP.call( nil, size, prot, MAP_SHARED, file.fileno, 0 )
+        ptr.to_i & FAILED == FAILED ? nil : ptr
+      end
+    end
+
+    def self.path name
+      name.to_s.include?( "/" ) ? name.to_s : File.join( DIR, "radspberry-#{name}" )
+    end
+
+    attr_reader :path, :size
+
+    # with a size the file is created (or grown) to it, without one it
+    # must already exist
+    def initialize name, size=nil, readonly=false
+      @path = self.class.path( name )
+      @readonly = readonly
+      mode = readonly ? File::RDONLY : size ? File::RDWR | File::CREAT : File::RDWR
+      @file = File.open( @path, mode, 0600 )
+      @file.binmode
+      @file.truncate( size ) if size && !readonly && @file.size < size
+      @size = @file.size
+      @ptr  = Mmap.map( @file, @size, readonly ? Mmap::PROT_READ : Mmap::PROT_RW )
+    end
+
+    # maps an existing file read-only, e.g. a cache shared by many readers
+    def self.readonly name
+      new( name, nil, true )
+    end
+
+    def mapped?
+      !!@ptr
+    end
+
+    def readonly?
+      @readonly
+    end
+
+    def read offset, length
+      @ptr ? @ptr[offset, length] : @file.pread( length, offset )
+    end
+
+    def write offset, bytes
+      raise IOError, "#{@path} is mapped read-only" if @readonly
+      @ptr ? @ptr[offset, bytes.bytesize] = bytes : @file.pwrite( bytes, offset )
+    end
+
+    def get_u64 offset
+      read( offset, 8 ).unpack( "Q<" )[0]
+    end
+
+    def put_u64 offset, value
+      write( offset, [value].pack( "Q<" ) )
+    end
+
+    def get_floats offset, count
+      read( offset, 4 * count ).unpack( "e*" )
+    end
+
+    def put_floats offset, values
+      write( offset, values.pack( "e*" ) )
+    end
+
+    def close
+      Mmap::MUNMAP.call( @ptr, @size ) if @ptr
+      @ptr = nil
+      @file.close
+    end
+
+    def unlink
+      File.unlink( @path ) if File.exist?( @path )
+    end
+  end
+
+end
@@ -0,0 +1,168 @@
+module DSP
+
+  # rendered audio published into a SharedMemory ring so other local
+  # processes (analysers, recorders, another radspberry) can read it
+  # without going through files. one writer, any number of readers; the
+  # writer never waits and simply overwrites the oldest slot, readers that
+  # fall behind notice from the sequence numbers and count an overrun.
+  #
+  #   Speaker.publish "synth"                 # tap the live output
+  #   src = ShmSource.new( "synth" )          # elsewhere: a Generator
+  #   Speaker[ GeneratorChain[ src, Hpf.new(100) ] ]
+  #
+  # layout: 64 byte header, then slots of [seq u64, frames u32, pad u32,
+  # frames float32]. a slot's seq is zeroed while it's being written, so a
+  # reader can tell a torn read by checking it before and after copying.
+  class ShmRing
+    MAGIC   = "RSPRING1"
+    VERSION = 1
+    HEADER  = 64
+    SLOT_HEADER = 16
+    WRITE_SEQ   = 32  # header offset of the last published seq
+
+    attr_reader :name, :slots, :frames, :srate, :overruns
+
+    def self.create name, opts={}
+      opts = opts.reverse_merge :slots => 64, :frames => 1024, :srate => Base.sampleRate
+      new( name, opts )
+    end
+
+    def self.open name, opts={}
+      new( name, opts.merge( :open => true ) )
+    end
+
+    # readers start at the newest block unless :from => :oldest
+    def initialize name, opts={}
+      @name = name
+      if opts[:open]
+        @mem = SharedMemory.new( name )
+        magic, version, @slots, @frames, channels, @srate = @mem.read( 0, 32 ).unpack( "a8VVVVE" )
+        raise ArgumentError, "#{@mem.path} is not a radspberry ring" unless magic == MAGIC
+        raise ArgumentError, "#{@mem.path} is ring version #{version}, expected #{VERSION}" unless version == VERSION
+        raise ArgumentError, "#{@mem.path} has #{channels} channels, only mono rings are supported" unless channels == 1
+        latest = @mem.get_u64( WRITE_SEQ )
+        @next = opts[:from] == :oldest ? [latest - @slots + 1, 1].max : latest + 1
+      else
+        @slots, @frames, @srate = opts[:slots], opts[:frames], opts[:srate].to_f
+        @mem = SharedMemory.new( name, HEADER + @slots * slot_size )
+        @mem.write( 0, [MAGIC, VERSION, @slots, @frames, 1, @srate].pack( "a8VVVVE" ) )
+        @seq = 0
+        @mem.put_u64( WRITE_SEQ, @seq )
+      end
+      @overruns = 0
+    end
+
+    # writer side: publishes block, split over as many slots as it needs
+    def << block
+      block = block.to_a
+      0.step( block.size - 1, @frames ) do |start|
+        publish( block[start, @frames] )
+      end
+      self
+    end
+
+    # reader side: the next block as an Array of floats, nil if nothing new.
+    # blocks that got overwritten before we read them count as overruns
+    def read
+      latest = @mem.get_u64( WRITE_SEQ )
+      return nil if @next > latest
+      if latest - @next >= @slots
+        oldest = latest - @slots + 1
+        @overruns += oldest - @next
+        @next = oldest
+      end
+      offset = slot_offset( @next )
+      seq, count = @mem.read( offset, 12 ).unpack( "Q<V" )
+      data = @mem.get_floats( offset + SLOT_HEADER, count )
+      if seq != @next || @mem.get_u64( offset ) != @next  # overwritten while copying
+        @overruns += 1
+        @next += 1
+        return read
+      end
+      @next += 1
+      data
+    end
+
+    def close
+      @mem.close
+    end
+
+    def unlink
+      @mem.unlink
+    end
+
+    private
+
+    def slot_size
+      SLOT_HEADER + 4 * @frames
+    end
+
+    def slot_offset seq
+      HEADER + ((seq - 1) % @slots) * slot_size
+    end
+
+    def publish data
+      seq = @seq + 1
+      offset = slot_offset( seq )
+      @mem.put_u64( offset, 0 )  # invalidate first
+      @mem.write( offset + 8, [data.size].pack( "V" ) )
+      @mem.put_floats( offset + SLOT_HEADER, data )
+      @mem.put_u64( offset, seq )
+      @mem.put_u64( WRITE_SEQ, @seq = seq )
+    end
+  end
+
+  # passes a generator through and publishes everything it renders
+  class ShmOutput < Generator
+    attr_reader :ring
+
+    def initialize gen, name, opts={}
+      @gen  = gen
+      @ring = ShmRing.create( name, opts.reverse_merge( :srate => gen.srate ) )
+    end
+
+    def tick
+      ticks( 1 )[0]
+    end
+
+    def ticks samples
+      @gen.ticks( samples ).tap{ |out| @ring << out }
+    end
+  end
+
+  # reads a ShmRing as a Generator. missing frames (the writer is behind
+  # or gone) come out as silence and count as underruns. there's no
+  # resampling, so a ring at another rate plays at the wrong pitch
+  class ShmSource < Generator
+    attr_reader :ring, :underruns
+
+    def initialize name, opts={}
+      @ring = ShmRing.open( name, opts )
+      if @ring.srate != srate
+        Log.warn "ring %s runs at %.0f Hz but the sample rate is %.0f Hz, it will play at the wrong speed", name, @ring.srate, srate
+      end
+      @buffer = []
+      @underruns = 0
+    end
+
+    def overruns
+      @ring.overruns
+    end
+
+    def tick
+      ticks( 1 )[0]
+    end
+
+    def ticks samples
+      while @buffer.size < samples && (block = @ring.read)
+        @buffer.concat( block )
+      end
+      if @buffer.size < samples
+        @underruns += 1
+        @buffer.concat( Array.full_of( 0.0, samples - @buffer.size ) )
+      end
+      @buffer.shift( samples ).to_v
+    end
+  end
+
+end
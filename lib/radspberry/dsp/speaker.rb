@@ -6,6 +6,8 @@ require 'ffi-portaudio'
 # example use:
 #   Speaker.new( SuperSaw, :frameSize => 2**12)[ :volume => 0.5, :synth => {:spread => 0.9, :freq => 200 }]
 #   Speaker[:volume => 0.5, :synth => {:spread => 0.9, :freq => 200 }]
+#   Speaker.record "take.wav"   # tap the output to disk, see Recorder
+#   Speaker.publish "synth"     # tap the output into shared memory, see ShmRing
 
 module DSP
   
@@ -18,9 +20,13 @@ module DSP
     param_accessor :synth,  :delegate => "@@stream"
 
     def new _synth, opts={}
+      recorder = @@stream.try(:recorder)  # keep recording across synth swaps
+      taps     = @@stream.try(:taps)
       @@stream.try(:close)
       _synth = _synth.new if _synth.is_a?(Class) # instantiate
       @@stream = AudioStream.new( _synth, opts[:frameSize] )
+      @@stream.recorder = recorder
+      @@stream.taps.concat( taps ) if taps
       self
     end
   
@@ -47,19 +53,52 @@ module DSP
     def toggleMute
       @@stream.muted = !@@stream.muted
     end
+
+    def record filename, opts={}
+      raise ArgumentError, "no stream initialized yet!" unless @@stream
+      stop_recording
+      opts = opts.reverse_merge :frameSize => @@stream.frameSize || 2**12, :srate => @@stream.synth.srate
+      @@stream.recorder = Recorder.new( filename, opts )
+    end
+
+    def stop_recording
+      return unless recorder = @@stream.try(:recorder)
+      @@stream.recorder = nil
+      recorder.stop
+    end
+
+    def recording?
+      !!@@stream.try(:recorder)
+    end
+
+    def publish name, opts={}
+      raise ArgumentError, "no stream initialized yet!" unless @@stream
+      opts = opts.reverse_merge :frames => @@stream.frameSize || 2**12, :srate => @@stream.synth.srate
+      ShmRing.create( name, opts ).tap{ |ring| @@stream.taps << ring }
+    end
+
+    def unpublish name
+      return unless ring = @@stream.try(:taps).try(:find){ |t| t.is_a?(ShmRing) && t.name == name }
+      @@stream.taps.delete( ring )
+      ring.close
+      ring.unlink
+    end
   
   end
 
   class AudioStream < FFI::PortAudio::Stream
     include FFI::PortAudio
-    attr_accessor :gain, :muted, :synth
+    attr_accessor :gain, :muted, :synth, :recorder
+    attr_reader :frameSize, :taps  # taps get every output block with <<
   
     def initialize gen, frameSize=2**12, gain=1.0  # 1024
       @synth = gen # responds to tick
       @gain  = gain
+      @frameSize = frameSize
+      @taps  = []
       @muted = false
       raise ArgumentError, "#{synth.class} doesn't respond to ticks!" unless @synth.respond_to?(:ticks)
-      init!( frameSize )
+      init!( @frameSize )
       start
     end
 
@@ -71,7 +110,10 @@ module DSP
         out = @synth.ticks( framesPerBuffer )
         out *= @gain unless gain == 1.0
       end
-      output.write_array_of_float out.to_a
+      out = out.to_a
+      @recorder << out if @recorder
+      @taps.each{ |t| t << out }
+      output.write_array_of_float out
       :paContinue
     end
 
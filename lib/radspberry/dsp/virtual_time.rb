@@ -0,0 +1,202 @@
+module DSP
+
+  # runs a script written for the Speaker (Speaker[...], setters, sleep)
+  # against a virtual clock and renders what it would have played into a
+  # file, as fast as it computes. inside the render, Speaker is a stand-in
+  # writing to the file, and the script's sleep renders that many seconds
+  # of the current synth instead of waiting, so every change a script makes
+  # lands on the sample it would have been heard at. a bare sleep (forever)
+  # ends the script. the sleep hook is a singleton method on the script's
+  # self (main for render_script), removed again when the render is done.
+  #
+  #   VirtualTime.render( "take.wav" ) do
+  #     Speaker[ SuperSaw.new ]
+  #     sleep 1
+  #     Speaker.synth.freq /= 2
+  #     sleep 1
+  #   end
+  #   VirtualTime.render_script( "example.rb", "example.wav", :format => :pcm16 )
+  #
+  # returns a Pipeline::Result (frames, elapsed, realtime_factor).
+  module VirtualTime
+    extend self
+
+    FOREVER = :radspberry_sleep_forever
+
+    def render filename, opts={}, &script
+      raise ArgumentError, "pass the script as a block" unless script
+      raise "already rendering in virtual time" if Thread.current[:radspberry_virtual_time]
+      speaker = VirtualSpeaker.new( filename, opts )
+      begin
+        swap_speaker( speaker ) do
+          hook_sleep( script.binding.receiver ) do
+            Thread.current[:radspberry_virtual_time] = speaker
+            begin
+              catch( FOREVER ){ script.call }
+            ensure
+              Thread.current[:radspberry_virtual_time] = nil
+            end
+          end
+        end
+      ensure
+        result = speaker.finish
+      end
+      result
+    end
+
+    def render_script path, filename, opts={}
+      main = TOPLEVEL_BINDING.receiver  # what a loaded file runs as
+      render( filename, opts, &main.instance_eval{ proc{ load path } } )
+    end
+
+    private
+
+    # routes the target's sleep to the virtual clock of the current thread,
+    # then takes the hook off again (putting back any singleton sleep)
+    def hook_sleep target
+      singleton = target.singleton_class
+      visibility = [:private, :public, :protected].find{ |v| singleton.send( :"#{v}_method_defined?", :sleep, false ) }
+      previous  = singleton.instance_method( :sleep ) if visibility
+      singleton.send( :define_method, :sleep ) do |*args|
+        (clock = Thread.current[:radspberry_virtual_time]) ? clock.sleep( *args ) : super( *args )
+      end
+      singleton.send( :private, :sleep )
+      hooked = true
+      yield
+    ensure
+      if hooked
+        singleton.send( :remove_method, :sleep )
+        if previous
+          singleton.send( :define_method, :sleep, previous )
+          singleton.send( visibility, :sleep )
+        end
+      end
+    end
+
+    # Speaker autoloads with the portaudio driver; leave it the way it was
+    def swap_speaker speaker
+      autoload = DSP.autoload?( :Speaker )
+      original = DSP.const_get( :Speaker ) if !autoload && DSP.const_defined?( :Speaker, false )
+      DSP.send( :remove_const, :Speaker ) if autoload || original
+      DSP.const_set( :Speaker, speaker )
+      yield
+    ensure
+      DSP.send( :remove_const, :Speaker )
+      DSP.autoload( :Speaker, autoload ) if autoload
+      DSP.const_set( :Speaker, original ) if original
+    end
+
+    # a mono wav written as it renders, float or through a Quantizer
+    class Writer
+      def initialize filename, opts
+        @bits, @format = Recorder::FORMATS[opts[:format]]
+        @wav = RiffFile.new( filename, "wb+" )
+        @wav.begin_data( 1, Base.sampleRate.to_i, @bits, @format )
+        @quantizer = Quantizer.new( @bits, :dither => opts[:dither], :shape => opts[:shape] ) unless @format == RiffFile::FORMAT_FLOAT
+      end
+
+      def << block
+        @wav.append_data( @quantizer ? @quantizer.pack( block ) : @wav.pack_samples( block, @bits, @format ) )
+        self
+      end
+
+      def close
+        @wav.finish_data
+        @wav.close
+      end
+    end
+
+    # the parts of Speaker scripts use, writing to a file
+    class VirtualSpeaker
+      attr_accessor :synth, :volume, :frame_size
+
+      def initialize filename, opts={}
+        opts = opts.reverse_merge :format => :float, :frameSize => 2**12, :dither => true, :shape => false
+        raise ArgumentError, "unknown format #{opts[:format]}" unless Recorder::FORMATS[opts[:format]]
+        @filename   = filename
+        @opts       = opts
+        @frame_size = opts[:frameSize]
+        @volume     = 1.0
+        @muted      = false
+        @frames     = 0
+        @time       = 0.0  # virtual seconds slept, so rounding doesn't drift
+        @started    = Process.clock_gettime( Process::CLOCK_MONOTONIC )
+        @out        = Writer.new( filename, opts )
+      end
+
+      def new synth, opts={}
+        synth = synth.new if synth.is_a?( Class )
+        raise ArgumentError, "#{synth.class} doesn't respond to ticks!" unless synth.respond_to?( :ticks )
+        @synth = synth
+        @frame_size = opts[:frameSize] if opts[:frameSize]
+        self
+      end
+
+      def [] opts={}
+        return new( opts ) if opts.is_a?( Class ) || opts.is_a?( DSP::Base )
+        raise ArgumentError, "no stream initialized yet!" unless @synth
+        @synth[ opts.delete( :synth ) || {} ]
+        opts.each_pair{ |k,v| send "#{k}=", v }
+        self
+      end
+
+      def mute;       @muted = true;    end
+      def unmute;     @muted = false;   end
+      def muted?;     @muted;           end
+      def toggleMute; @muted = !@muted; end
+
+      # also renders into filename from now on
+      def record filename, opts={}
+        stop_recording
+        @recording = Writer.new( filename, @opts.merge( opts ) )
+      end
+
+      def stop_recording
+        @recording.close if @recording
+        @recording = nil
+      end
+
+      def recording?
+        !!@recording
+      end
+
+      def publish name, opts={}
+        Log.warn "virtual time: not publishing %s, nothing is listening", name
+      end
+
+      def unpublish name
+      end
+
+      # the virtual clock: renders seconds of the current synth. with no
+      # argument the script would never wake up, so it ends here
+      def sleep seconds=nil
+        throw FOREVER unless seconds
+        @time += seconds
+        render( (@time * Base.sampleRate).round - @frames )
+        seconds.round
+      end
+
+      def finish
+        stop_recording
+        @out.close
+        ::Pipeline::Result.new( nil, @filename, @frames, Base.sampleRate.to_i,
+                              Process.clock_gettime( Process::CLOCK_MONOTONIC ) - @started )
+      end
+
+      private
+
+      def render frames
+        while frames > 0
+          n = [frames, @frame_size].min
+          block = @synth && !@muted ? @synth.ticks( n ).to_a : Array.new( n, 0.0 )
+          block = block.map{ |s| s * @volume } unless @volume == 1.0
+          @out << block
+          @recording << block if @recording
+          @frames += n
+          frames  -= n
+        end
+      end
+    end
+  end
+
+end
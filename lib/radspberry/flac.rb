@@ -0,0 +1,648 @@
+require 'digest/md5'
+
+#
+# FLAC reading and writing, alongside RiffFile
+#
+# the encoder works a block at a time: each channel block gets the
+# cheapest of constant / verbatim / fixed (orders 0-4) / LPC prediction,
+# stereo gets the cheapest of independent, left/side, right/side and
+# mid/side, and residuals are rice coded with partitions chosen by
+# estimate. memory is bounded by one block (or the few blocks queued for
+# the background encoder with :threaded => true).
+#
+#   FlacFile.new("out.flac", "wb") do |flac|
+#     flac.begin_data(2, 44100, 16, :threaded => true)
+#     flac.append_samples(interleaved_ints)   # as often as you like
+#     flac.finish_data
+#   end
+#
+#   FlacFile.new("in.flac", "r") { |flac| flac.each_block { |samples| ... } }
+#
+
+class FlacFile
+
+  MAGIC = "fLaC"
+  BLOCK_SIZE = 4096
+  MAX_LPC_ORDER = 8
+  MAX_FIXED_ORDER = 4
+  MAX_PARTITION_ORDER = 6
+  STREAMINFO_LENGTH = 34
+  QUEUE_BLOCKS = 4  # blocks the background encoder may fall behind
+
+  SAMPLE_RATE_CODES = { 88200 => 1, 176400 => 2, 192000 => 3, 8000 => 4, 16000 => 5, 22050 => 6,
+                        24000 => 7, 32000 => 8, 44100 => 9, 48000 => 10, 96000 => 11 }
+  BIT_DEPTH_CODES   = { 8 => 1, 12 => 2, 16 => 4, 20 => 5, 24 => 6, 32 => 7 }
+
+  INDEPENDENT, LEFT_SIDE, RIGHT_SIDE, MID_SIDE = nil, 8, 9, 10
+
+  CRC8_TABLE = (0..255).map do |byte|
+    8.times.inject(byte) { |crc, _| crc & 0x80 != 0 ? ((crc << 1) ^ 0x07) & 0xFF : (crc << 1) & 0xFF }
+  end
+  CRC16_TABLE = (0..255).map do |byte|
+    8.times.inject(byte << 8) { |crc, _| crc & 0x8000 != 0 ? ((crc << 1) ^ 0x8005) & 0xFFFF : (crc << 1) & 0xFFFF }
+  end
+
+  def self.crc8(bytes)
+    bytes.each_byte.inject(0) { |crc, b| CRC8_TABLE[crc ^ b] }
+  end
+
+  def self.crc16(bytes)
+    bytes.each_byte.inject(0) { |crc, b| ((crc << 8) & 0xFFFF) ^ CRC16_TABLE[(crc >> 8) ^ b] }
+  end
+
+  # STREAMINFO only: one 42 byte read
+  def self.probe(path)
+    File.open(path, 'rb') do |file|
+      head = file.read(8 + STREAMINFO_LENGTH)
+      return nil unless head && head.size == 8 + STREAMINFO_LENGTH && head[0, 4] == MAGIC
+      info = StreamInfo.unpack(head[8, STREAMINFO_LENGTH])
+      RiffFile::Probe.new(RiffFile::FORMAT_PCM, info.channels, info.sample_rate, info.bit_depth, info.total_samples)
+    end
+  end
+
+  StreamInfo = Struct.new(:min_block, :max_block, :min_frame, :max_frame, :sample_rate,
+                          :channels, :bit_depth, :total_samples, :md5) do
+    def self.unpack(bytes)
+      bits = bytes.unpack("B*")[0]
+      fields = [16, 16, 24, 24, 20, 3, 5, 36].inject([0]) { |pos, n| pos << pos.last + n }
+      values = fields.each_cons(2).map { |a, b| bits[a...b].to_i(2) }
+      values[5] += 1  # channels - 1
+      values[6] += 1  # bits per sample - 1
+      new(*values, bytes[18, 16])
+    end
+
+    def pack
+      w = BitWriter.new
+      [[min_block, 16], [max_block, 16], [min_frame, 24], [max_frame, 24], [sample_rate, 20],
+       [channels - 1, 3], [bit_depth - 1, 5], [total_samples, 36]].each { |v, n| w.write(v, n) }
+      w.to_s + md5
+    end
+  end
+
+  attr_reader :info
+
+  def initialize(file, mode)
+    @file = File.open(file, mode)
+    @file.binmode
+    begin
+      read_metadata if mode == 'r'
+    rescue StandardError
+      @file.close
+      raise
+    end
+    if block_given?
+      yield self
+      close
+    end
+  end
+
+  def close
+    @file.close
+  end
+
+  #####################
+  # reading
+  #####################
+
+  def format
+    RiffFile::Probe.new(RiffFile::FORMAT_PCM, @info.channels, @info.sample_rate, @info.bit_depth, @info.total_samples)
+  end
+
+  def full_scale
+    2 ** (@info.bit_depth - 1)
+  end
+
+  def total_samples
+    @info.total_samples
+  end
+
+  def duration
+    @info.total_samples.to_f / @info.sample_rate
+  end
+
+  def read_metadata
+    raise ArgumentError, "not a FLAC file" unless @file.read(4) == MAGIC
+    loop do
+      header = read_exactly(4).unpack("N")[0]
+      last, type, length = header >> 31, (header >> 24) & 0x7F, header & 0xFFFFFF
+      body = read_exactly(length)
+      if type == 0
+        raise ArgumentError, "FLAC STREAMINFO is too short" if length < STREAMINFO_LENGTH
+        @info = StreamInfo.unpack(body)
+      end
+      break if last == 1
+    end
+    raise ArgumentError, "FLAC file has no STREAMINFO" unless @info
+    @frames_begin = @file.tell
+  end
+
+  # yields interleaved sample values one frame at a time, in constant memory
+  def each_block
+    return enum_for(:each_block) unless block_given?
+    position = @frames_begin
+    window = @info.max_frame > 0 ? @info.max_frame : @info.max_block * @info.channels * (@info.bit_depth + 1) / 8 + 64
+    while position < @file.size
+      @file.seek(position)
+      reader = BitReader.new(@file.read(window))
+      channels = decode_frame(reader)
+      position += reader.byte_pos
+      yield channels.size == 1 ? channels[0] : channels[0].zip(*channels[1..-1]).flatten
+    end
+  end
+
+  def simple_read #returns all sample values for entire file
+    each_block.inject([]) { |all, samples| all.concat(samples) }
+  end
+
+  def decode_frame(r)
+    raise ArgumentError, "lost FLAC frame sync" unless r.read(15) == 0x7FFC
+    r.read(1)  # blocking strategy, the frame number below covers both
+    block_code, rate_code, assignment, depth_code = r.read(4), r.read(4), r.read(4), r.read(3)
+    r.read(1)
+    r.read_utf8
+    block_size = case block_code
+      when 1 then 192
+      when 2..5 then 576 << (block_code - 2)
+      when 6 then r.read(8) + 1
+      when 7 then r.read(16) + 1
+      else 256 << (block_code - 8)
+    end
+    case rate_code
+      when 12 then r.read(8)
+      when 13, 14 then r.read(16)
+    end
+    bit_depth = depth_code == 0 ? @info.bit_depth : BIT_DEPTH_CODES.key(depth_code)
+    r.read(8)  # crc8, the frame crc16 covers the header too
+
+    channels = case assignment
+      when LEFT_SIDE  then [decode_subframe(r, block_size, bit_depth), decode_subframe(r, block_size, bit_depth + 1)]
+      when RIGHT_SIDE then [decode_subframe(r, block_size, bit_depth + 1), decode_subframe(r, block_size, bit_depth)]
+      when MID_SIDE   then [decode_subframe(r, block_size, bit_depth), decode_subframe(r, block_size, bit_depth + 1)]
+      else (assignment + 1).times.map { decode_subframe(r, block_size, bit_depth) }
+    end
+    r.align
+    frame_end = r.byte_pos
+    crc = r.read(16)
+    DSP::Log.warn "FLAC frame crc mismatch" if crc != FlacFile.crc16(r.bytes[0, frame_end])
+
+    case assignment
+      when LEFT_SIDE  then [channels[0], channels[0].zip(channels[1]).map { |l, s| l - s }]
+      when RIGHT_SIDE then [channels[0].zip(channels[1]).map { |s, rt| s + rt }, channels[1]]
+      when MID_SIDE
+        channels[0].zip(channels[1]).map do |mid, side|
+          mid = (mid << 1) | (side & 1)
+          [(mid + side) >> 1, (mid - side) >> 1]
+        end.transpose
+      else channels
+    end
+  end
+
+  def decode_subframe(r, block_size, bit_depth)
+    r.read(1)
+    type = r.read(6)
+    wasted = r.read(1) == 1 ? r.read_unary + 1 : 0
+    bit_depth -= wasted
+    samples = if type == 0
+      [r.read_signed(bit_depth)] * block_size
+    elsif type == 1
+      block_size.times.map { r.read_signed(bit_depth) }
+    elsif type >= 8 && type <= 12
+      order = type & 7
+      warmup = order.times.map { r.read_signed(bit_depth) }
+      FlacFile.restore_fixed(warmup, read_residual(r, block_size, order), order)
+    elsif type >= 32
+      order = (type & 31) + 1
+      warmup = order.times.map { r.read_signed(bit_depth) }
+      precision = r.read(4) + 1
+      shift = r.read_signed(5)
+      coefs = order.times.map { r.read_signed(precision) }
+      FlacFile.restore_lpc(warmup, read_residual(r, block_size, order), coefs, shift)
+    else
+      raise ArgumentError, "reserved FLAC subframe type #{type}"
+    end
+    wasted > 0 ? samples.map { |s| s << wasted } : samples
+  end
+
+  def read_residual(r, block_size, order)
+    param_bits = r.read(2) == 0 ? 4 : 5
+    escape = (1 << param_bits) - 1
+    partition_order = r.read(4)
+    partitions = 1 << partition_order
+    residual = []
+    partitions.times do |p|
+      n = (block_size >> partition_order) - (p == 0 ? order : 0)
+      k = r.read(param_bits)
+      if k == escape
+        bits = r.read(5)
+        n.times { residual << r.read_signed(bits) }
+      else
+        n.times { residual << r.read_rice(k) }
+      end
+    end
+    residual
+  end
+
+  #####################
+  # prediction kernels, whole blocks at a time
+  #####################
+
+  # residual of the fixed polynomial predictor of the given order is the
+  # order-th difference of the signal
+  def self.fixed_residual(samples, order)
+    order.times.inject(samples) { |d, _| d.each_cons(2).map { |a, b| b - a } }
+  end
+
+  def self.restore_fixed(warmup, residual, order)
+    samples = warmup.dup
+    case order
+      when 0 then samples.concat(residual)
+      when 1 then residual.each { |e| samples << e + samples[-1] }
+      when 2 then residual.each { |e| samples << e + 2 * samples[-1] - samples[-2] }
+      when 3 then residual.each { |e| samples << e + 3 * samples[-1] - 3 * samples[-2] + samples[-3] }
+      when 4 then residual.each { |e| samples << e + 4 * samples[-1] - 6 * samples[-2] + 4 * samples[-3] - samples[-4] }
+    end
+    samples
+  end
+
+  def self.lpc_residual(samples, coefs, shift)
+    order = coefs.size
+    (order...samples.size).map do |i|
+      sum = 0
+      order.times { |j| sum += coefs[j] * samples[i - j - 1] }
+      samples[i] - (sum >> shift)
+    end
+  end
+
+  def self.restore_lpc(warmup, residual, coefs, shift)
+    samples = warmup.dup
+    order = coefs.size
+    residual.each do |e|
+      sum = 0
+      i = samples.size
+      order.times { |j| sum += coefs[j] * samples[i - j - 1] }
+      samples << e + (sum >> shift)
+    end
+    samples
+  end
+
+  # welch windowed autocorrelation + levinson-durbin, coefficients
+  # quantized to precision bits with the rounding error carried along
+  def self.lpc_coefficients(samples, order, precision)
+    n = samples.size
+    half = 0.5 * (n - 1)
+    x = samples.each_with_index.map { |s, i| w = (i - half) / half; s * (1.0 - w * w) }
+    r = (0..order).map { |lag| (lag...n).inject(0.0) { |sum, i| sum + x[i] * x[i - lag] } }
+    return nil if r[0] <= 0
+
+    a = []
+    err = r[0]
+    order.times do |i|
+      acc = r[i + 1]
+      i.times { |j| acc -= a[j] * r[i - j] }
+      k = acc / err
+      a = a.each_with_index.map { |c, j| c - k * a[i - 1 - j] } << k
+      err *= (1.0 - k * k)
+      break if err <= 0
+    end
+
+    cmax = a.map(&:abs).max
+    return nil if cmax.nil? || cmax == 0
+    shift = [[precision - 1 - (Math.log2(cmax).floor + 1), 0].max, 15].min
+    limit = 1 << (precision - 1)
+    carry = 0.0
+    coefs = a.map do |c|
+      v = c * (1 << shift) + carry
+      q = [[v.round, -limit].max, limit - 1].min
+      carry = v - q
+      q
+    end
+    [coefs, shift]
+  end
+
+  #####################
+  # writing
+  #####################
+
+  def write(channels, sample_rate, bit_depth, audio_data) #writes to audio file, like RiffFile#write
+    begin_data(channels, sample_rate, bit_depth)
+    append_samples(channels > 1 ? audio_data[0].zip(*audio_data[1..-1]).flatten : audio_data[0])
+    finish_data
+  end
+
+  def begin_data(channels, sample_rate, bit_depth, opts = {})
+    raise ArgumentError, "FLAC can't store #{bit_depth} bit samples" unless BIT_DEPTH_CODES[bit_depth]
+    @block_size = opts[:block_size] || BLOCK_SIZE
+    @lpc_order  = opts[:lpc_order] || MAX_LPC_ORDER
+    @info = StreamInfo.new(@block_size, @block_size, 0xFFFFFF, 0, sample_rate, channels, bit_depth, 0, 0.chr * 16)
+    @md5 = Digest::MD5.new
+    @pending = []
+    @frame_number = 0
+    @file.seek(0)
+    @file.print(MAGIC)
+    @file.print([(1 << 31) | STREAMINFO_LENGTH].pack("N"))  # last metadata block, type 0
+    @file.print(@info.pack)
+    if opts[:threaded]
+      queue = @queue = SizedQueue.new(opts[:queue] || QUEUE_BLOCKS)
+      @encoder = Thread.new do
+        begin
+          while (block = queue.pop) != :done
+            encode_block(block)
+          end
+        rescue StandardError
+          queue.close  # wakes a producer blocked in push
+          raise
+        end
+      end
+      @encoder.report_on_exception = false  # join re-raises it in the producer
+    end
+  end
+
+  def append_samples(interleaved)
+    @pending.concat(interleaved)
+    frame_length = @block_size * @info.channels
+    while @pending.size >= frame_length
+      enqueue_block(@pending.shift(frame_length))
+    end
+  end
+
+  def finish_data
+    enqueue_block(@pending) unless @pending.empty?
+    @pending = []
+    if @encoder
+      enqueue_block(:done)
+      join_encoder
+    end
+    @info.min_frame = 0 if @info.min_frame == 0xFFFFFF
+    @info.md5 = @md5.digest
+    @file.seek(8)
+    @file.print(@info.pack)
+    @file.flush
+  end
+
+  private
+
+  def read_exactly(n)
+    bytes = @file.read(n) || ""
+    raise ArgumentError, "FLAC file is truncated" if bytes.bytesize < n
+    bytes
+  end
+
+  def enqueue_block(interleaved)
+    @encoder ? @queue.push(interleaved) : encode_block(interleaved)
+  rescue ClosedQueueError  # the encoder died: raise its error here
+    join_encoder
+  end
+
+  def join_encoder
+    encoder, @encoder, @queue = @encoder, nil, nil
+    encoder.join
+  end
+
+  def encode_block(interleaved)
+    channels = @info.channels
+    bit_depth = @info.bit_depth
+    @md5.update(pack_for_md5(interleaved))
+    block = channels == 1 ? [interleaved] : channels.times.map { |c| (c...interleaved.size).step(channels).map { |i| interleaved[i] } }
+    size = block[0].size
+
+    assignment, subframes = decorrelate(block)
+    w = BitWriter.new
+    w.write(0x7FFC, 15)
+    w.write(0, 1)                                   # fixed block size
+    w.write(size < 256 ? 6 : 7, 4)                  # block size stored after the frame number
+    w.write(SAMPLE_RATE_CODES[@info.sample_rate] || 0, 4)
+    w.write(assignment || channels - 1, 4)
+    w.write(BIT_DEPTH_CODES[bit_depth], 3)
+    w.write(0, 1)
+    utf8(@frame_number).each { |b| w.write(b, 8) }
+    size < 256 ? w.write(size - 1, 8) : w.write(size - 1, 16)
+    w.write(FlacFile.crc8(w.to_s), 8)
+
+    subframes.each { |samples, depth| encode_subframe(w, samples, depth) }
+    w.align
+    w.write(FlacFile.crc16(w.to_s), 16)
+    frame = w.to_s
+    @file.print(frame)
+
+    @frame_number += 1
+    @info.total_samples += size
+    @info.min_frame = [@info.min_frame, frame.size].min
+    @info.max_frame = [@info.max_frame, frame.size].max
+  end
+
+  # picks the channel assignment whose second order residuals are smallest
+  def decorrelate(block)
+    bit_depth = @info.bit_depth
+    return [INDEPENDENT, block.map { |c| [c, bit_depth] }] unless block.size == 2
+    left, right = block
+    side = left.zip(right).map { |l, r| l - r }
+    mid  = left.zip(right).map { |l, r| (l + r) >> 1 }
+    cost = lambda { |c| FlacFile.fixed_residual(c, 2).inject(0) { |sum, e| sum + e.abs } }
+    l, r, s, m = [left, right, side, mid].map(&cost)
+    case [l + r, l + s, r + s, m + s].each_with_index.min[1]
+      when 0 then [INDEPENDENT, [[left, bit_depth], [right, bit_depth]]]
+      when 1 then [LEFT_SIDE,   [[left, bit_depth], [side, bit_depth + 1]]]
+      when 2 then [RIGHT_SIDE,  [[side, bit_depth + 1], [right, bit_depth]]]
+      else        [MID_SIDE,    [[mid, bit_depth], [side, bit_depth + 1]]]
+    end
+  end
+
+  def encode_subframe(w, samples, bit_depth)
+    if samples.all? { |s| s == samples[0] }
+      w.write(0, 8)
+      w.write_signed(samples[0], bit_depth)
+      return
+    end
+    size = samples.size
+    best = [size * bit_depth, :verbatim]
+
+    (0..[MAX_FIXED_ORDER, size - 1].min).each do |order|
+      residual = FlacFile.fixed_residual(samples, order)
+      bits = order * bit_depth + residual_bits(residual, size, order)[0]
+      best = [bits, :fixed, order, residual] if bits < best[0]
+    end
+
+    order = [@lpc_order, size - 1, 32].min
+    if order > 0 && (lpc = FlacFile.lpc_coefficients(samples, order, precision = bit_depth <= 16 ? 12 : 15))
+      coefs, shift = lpc
+      residual = FlacFile.lpc_residual(samples, coefs, shift)
+      bits = order * (bit_depth + precision) + 9 + residual_bits(residual, size, order)[0]
+      best = [bits, :lpc, order, residual, coefs, shift, precision] if bits < best[0]
+    end
+
+    case best[1]
+      when :verbatim
+        w.write(1 << 1, 8)
+        samples.each { |s| w.write_signed(s, bit_depth) }
+      when :fixed
+        order, residual = best[2], best[3]
+        w.write((8 | order) << 1, 8)
+        order.times { |i| w.write_signed(samples[i], bit_depth) }
+        write_residual(w, residual, size, order)
+      when :lpc
+        order, residual, coefs, shift, precision = best[2..6]
+        w.write((32 | (order - 1)) << 1, 8)
+        order.times { |i| w.write_signed(samples[i], bit_depth) }
+        w.write(precision - 1, 4)
+        w.write_signed(shift, 5)
+        coefs.each { |c| w.write_signed(c, precision) }
+        write_residual(w, residual, size, order)
+    end
+  end
+
+  # estimated size in bits and the rice parameter of each partition for
+  # the best partition order
+  def residual_bits(residual, size, order)
+    folded = residual.map { |e| e >= 0 ? e << 1 : (-e << 1) - 1 }
+    best = nil
+    (0..MAX_PARTITION_ORDER).each do |partition_order|
+      break if size % (1 << partition_order) != 0 || (size >> partition_order) <= order
+      params = []
+      bits = 6
+      start = 0
+      (1 << partition_order).times do |p|
+        n = (size >> partition_order) - (p == 0 ? order : 0)
+        sum = 0
+        folded[start, n].each { |u| sum += u }
+        start += n
+        k = 0
+        k += 1 while k < 30 && (n << (k + 1)) <= sum
+        params << k
+        bits += 5 + n * (k + 1) + (sum >> k)
+      end
+      best = [bits, params, partition_order, folded] if best.nil? || bits < best[0]
+    end
+    best
+  end
+
+  def write_residual(w, residual, size, order)
+    _bits, params, partition_order, folded = residual_bits(residual, size, order)
+    rice2 = params.max > 14
+    w.write(rice2 ? 1 : 0, 2)
+    w.write(partition_order, 4)
+    start = 0
+    params.each_with_index do |k, p|
+      n = (size >> partition_order) - (p == 0 ? order : 0)
+      w.write(k, rice2 ? 5 : 4)
+      folded[start, n].each { |u| w.write_rice(u, k) }
+      start += n
+    end
+  end
+
+  def utf8(n)
+    return [n] if n < 0x80
+    length = [0x800, 0x10000, 0x200000, 0x4000000, 0x80000000].index { |limit| n < limit }
+    length = length ? length + 2 : 7
+    first = ((0xFF << (8 - length)) & 0xFF) | (n >> (6 * (length - 1)))
+    [first] + (length - 1).downto(1).map { |i| 0x80 | ((n >> (6 * (i - 1))) & 0x3F) }
+  end
+
+  def pack_for_md5(samples)
+    case @info.bit_depth
+      when 8 then samples.pack("c*")
+      when 16 then samples.pack("s<*")
+      when 32 then samples.pack("l<*")
+      else
+        bytes = (@info.bit_depth + 7) / 8
+        samples.pack("l<*").unpack("a#{bytes}x#{4 - bytes}" * samples.size).join
+    end
+  end
+
+  # msb-first bit packing into bytes
+  class BitWriter
+    def initialize
+      @bytes = []
+      @acc = 0
+      @bits = 0
+    end
+
+    def write(value, bits)
+      @acc = (@acc << bits) | value
+      @bits += bits
+      flush if @bits >= 32
+    end
+
+    def write_signed(value, bits)
+      write(value & ((1 << bits) - 1), bits)
+    end
+
+    # unary quotient as zeros and a stop bit, then k low bits
+    def write_rice(u, k)
+      write((1 << k) | (u & ((1 << k) - 1)), (u >> k) + 1 + k)
+    end
+
+    def align
+      write(0, 8 - @bits % 8) if @bits % 8 != 0
+    end
+
+    def to_s
+      flush
+      @bytes.pack("C*")
+    end
+
+    private
+
+    def flush
+      while @bits >= 8
+        @bits -= 8
+        @bytes << ((@acc >> @bits) & 0xFF)
+      end
+      @acc &= (1 << @bits) - 1
+    end
+  end
+
+  # works on the frame as a string of '0'/'1' so unary codes are one index call
+  class BitReader
+    attr_reader :bytes
+
+    def initialize(bytes)
+      @bytes = bytes
+      @bits = bytes.unpack("B*")[0]
+      @pos = 0
+    end
+
+    def read(n)
+      return 0 if n == 0
+      value = @bits[@pos, n].to_i(2)
+      @pos += n
+      value
+    end
+
+    def read_signed(n)
+      return 0 if n == 0
+      value = read(n)
+      value >= (1 << (n - 1)) ? value - (1 << n) : value
+    end
+
+    def read_unary
+      stop = @bits.index("1", @pos) or raise ArgumentError, "truncated FLAC frame"
+      zeros = stop - @pos
+      @pos = stop + 1
+      zeros
+    end
+
+    def read_rice(k)
+      u = (read_unary << k) | read(k)
+      (u >> 1) ^ -(u & 1)
+    end
+
+    def read_utf8
+      first = read(8)
+      ones = 0
+      ones += 1 while ones < 8 && first[7 - ones] == 1
+      return first if ones == 0
+      value = first & (0xFF >> (ones + 1))
+      (ones - 1).times { value = (value << 6) | (read(8) & 0x3F) }
+      value
+    end
+
+    def align
+      @pos = (@pos + 7) & ~7
+    end
+
+    def byte_pos
+      @pos >> 3
+    end
+  end
+
+end
@@ -1,10 +1,13 @@
-require 'portmidi'
-
 module MIDI
   extend self
 
+  def portmidi  # the driver is only loaded once a device is used
+    require 'portmidi'
+    Portmidi
+  end
+
   def devices
-    Portmidi.input_devices
+    portmidi.input_devices
   end
   
   def select_device arg
@@ -21,14 +24,46 @@ module MIDI
   @@input = nil
   at_exit do
     if @@input
-      puts "closing PortMidi device..."
+      DSP::Log.info "closing PortMidi device..."
       @@input.close
-      puts "done!"
     end
   end
   
   def input
-    @@input ||= devices && Portmidi::Input.new( device )
+    @@input ||= devices && portmidi::Input.new( device )
+  end
+
+  # older portmidi gems only wrap input; say so rather than NoMethodError
+  def output_devices
+    pm = portmidi
+    unless pm.respond_to?( :output_devices ) && pm.const_defined?( :Output, false )
+      raise NotImplementedError, "this portmidi gem has no output support (Portmidi.output_devices, " \
+                                 "Portmidi::Output); install one that has, or pass MIDI::Clock a :port"
+    end
+    pm.output_devices
+  end
+
+  def select_output_device arg
+    raise ArgumentError, "device doesn't exist\n  choose from: #{output_devices}" unless output_devices[arg]
+    @@output.try(:close)
+    @@output = nil
+    @@output_device = arg
+  end
+
+  def output_device
+    @@output_device ||= 0
+  end
+
+  @@output = nil
+  at_exit do
+    if @@output
+      DSP::Log.info "closing PortMidi output device..."
+      @@output.close
+    end
+  end
+
+  def output
+    @@output ||= output_devices && portmidi::Output.new( output_device )
   end
 
   class Note < Struct.new( :note, :velocity, :channel, :delta ); end
@@ -80,17 +115,23 @@ module MIDI
   module Player
     extend self
 
-    def [] gen      
-      DSP::Speaker[ @gen = gen ].volume = 0
+    # plays gen monophonically, through an envelope so notes don't click
+    def [] gen, env=DSP::Envelope.adsr( 0.005, 0.1, 0.8, 0.2 )
+      DSP::Speaker[ @voice = DSP::VCA.new( gen, env ) ]
       loop do
         MIDI::process.each do |event|
           case event
           when Note
-            p event
-            DSP::Speaker.volume = event.velocity / 128.0
-            @gen.freq = MIDI::krystal_freq( event.note )
+            DSP::Log.debug "note %d velocity %d channel %d", event.note, event.velocity, event.channel
+            if event.velocity > 0
+              @note = event.note
+              @voice.freq = MIDI::krystal_freq( event.note )
+              @voice.env.trigger( event.velocity / 127.0 )
+            elsif event.note == @note
+              @voice.env.release
+            end
           else # :all_notes_off
-            DSP::Speaker.volume = 0
+            @voice.env.release
           end
         end
       end
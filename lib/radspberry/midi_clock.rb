@@ -0,0 +1,155 @@
+module MIDI
+
+  # radspberry as the MIDI clock source. wrapped around the synth, it
+  # counts the samples the audio side renders and stamps clock pulses (24
+  # a quarter), start/stop and notes with the sample they fall on; they
+  # go through a RingBuffer to a sender thread that writes each one to the
+  # port when its time comes. the sender blocks until the audio side rings
+  # it and then sleeps until each message is due, so its timing comes from
+  # the audio clock; expect a millisecond or so of wakeup jitter.
+  #
+  #   clock = MIDI::Clock.new( SuperSaw.new, :bpm => 128 )
+  #   Speaker[ clock ]
+  #   clock.start
+  #   clock.note_out clock.beat_time( 4 ), 60, 100, 0.5   # on the fifth beat
+  #   clock.at_beat( 8 ){ |synth| synth.spread = 0.9 }     # audio events too
+  #
+  # it's a DSP::Sequencer, so everything a Sequencer schedules works here.
+  # sample times become wall times through an offset between the sample
+  # clock and the monotonic clock, the smallest seen (blocks only ever run
+  # late) let up slowly so it follows drift between the two. :latency
+  # (seconds) delays every message to line up with audio output latency.
+  class Clock < DSP::Sequencer
+    PPQ   = 24
+    DRIFT = 1e-4  # seconds per second the offset may creep up
+
+    START, CONTINUE, STOP, PULSE = 0xfa, 0xfb, 0xfc, 0xf8
+
+    Message = Struct.new( :due, :status, :data1, :data2 )
+
+    # one hook for all of them: clocks still open at exit send what's queued
+    @@live = []
+    at_exit{ @@live.dup.each( &:close ) }
+
+    attr_reader :bpm, :pulses, :port
+
+    def initialize synth, opts={}
+      opts = opts.reverse_merge :bpm => 120.0, :latency => 0.0, :queue => 4096
+      super synth, :queue => opts[:queue]
+      @port    = opts[:port] || MIDI.output
+      @latency = opts[:latency]
+      @out     = DSP::RingBuffer.new( opts[:queue] ){ Message.new }
+      @running = false
+      @pulses  = 0
+      @beat0   = 0
+      @bell    = Queue.new  # one ring per message in @out
+      self.bpm = opts[:bpm]
+      @sender  = Thread.new{ send_loop }
+      @@live << self
+    end
+
+    def bpm= bpm
+      @bpm = bpm.to_f
+      @per_pulse = DSP::Base.sampleRate * 60.0 / (@bpm * PPQ)  # samples, fractional
+    end
+
+    def running?
+      @running
+    end
+
+    # messages the sender couldn't keep up with
+    def dropped
+      @out.dropped
+    end
+
+    # starts the clock (and beat 0) at seconds on the sample clock
+    def start seconds=position
+      @beat0 = (seconds * DSP::Base.sampleRate).round
+      schedule( seconds, :start )
+    end
+
+    def stop seconds=position
+      schedule( seconds, :stop )
+    end
+
+    # seconds on the sample clock of a beat counted from start, at the
+    # current tempo
+    def beat_time beat
+      (@beat0 + beat * PPQ * @per_pulse) * DSP::Base.inv_srate
+    end
+
+    def at_beat beat, &block
+      at( beat_time( beat ), &block )
+    end
+
+    def note_out seconds, note, velocity=100, length=nil, channel=0
+      schedule( seconds, :midi, [0x90 | channel, note, velocity] )
+      schedule( seconds + length, :midi, [0x80 | channel, note, 0] ) if length
+    end
+
+    def control samples
+      now = Process.clock_gettime( Process::CLOCK_MONOTONIC )
+      offset  = now - @pos * DSP::Base.inv_srate
+      @offset = @offset ? [@offset + DRIFT * samples * DSP::Base.inv_srate, offset].min : offset
+      stop = @pos + samples
+      while @running && (t = @next_pulse.round) < stop
+        emit( t, PULSE )
+        @pulses += 1
+        @next_pulse += @per_pulse
+      end
+      super
+    end
+
+    def close
+      return unless @sender
+      @bell.close
+      @sender.join
+      @sender = nil
+      @@live.delete( self )
+    end
+
+    private
+
+    def fire e
+      case e.kind
+      when :start
+        @running, @pulses, @next_pulse = true, 0, e.time.to_f
+        emit( e.time, START )
+      when :stop
+        @running = false
+        emit( e.time, STOP )
+      when :midi
+        emit( e.time, *e.target )
+      else
+        super
+      end
+    end
+
+    # audio side: never blocks (an unbounded Queue push doesn't wait)
+    def emit time, status, data1=0, data2=0
+      due = (@offset || Process.clock_gettime( Process::CLOCK_MONOTONIC )) + time * DSP::Base.inv_srate + @latency
+      pushed = @out.push{ |m| m.due = due; m.status = status; m.data1 = data1; m.data2 = data2 }
+      @bell << true if pushed
+    end
+
+    # pop blocks while nothing is queued and returns nil once close has
+    # been called and every ring is answered
+    def send_loop
+      while @bell.pop
+        @out.pop do |m|
+          wait_until( m.due )
+          @port.write( [{ :message => [m.status, m.data1, m.data2], :timestamp => 0 }] )
+        end
+      end
+    rescue => e
+      DSP::Log.warn "midi clock: sender stopped: %s", e.message
+    end
+
+    def wait_until due
+      while (left = due - Process.clock_gettime( Process::CLOCK_MONOTONIC )) > 0
+        sleep left
+      end
+    end
+  end
+
+end
@@ -0,0 +1,134 @@
+module MIDI
+
+  # Standard MIDI File reader (formats 0 and 1). all tracks are merged
+  # into one list of note events, timed in seconds through the tempo map;
+  # everything but notes and tempo changes is skipped.
+  #
+  #   smf = MIDI::SMF.read( "song.mid" )
+  #   smf.notes.first  # => #<struct time=0.0, kind=:on, note=60, velocity=100, channel=0>
+  #   smf.duration
+  class SMF
+    class FormatError < ArgumentError; end
+
+    Event = Struct.new( :time, :kind, :note, :velocity, :channel )  # kind :on or :off
+    DEFAULT_TEMPO = 500_000  # microseconds per quarter, 120bpm
+
+    attr_reader :format, :division, :track_count, :notes
+
+    def self.read path
+      new( File.binread( path ) )
+    end
+
+    def initialize data
+      @data = data.b
+      @pos  = 0
+      raise FormatError, "not a MIDI file" unless chunk == "MThd"
+      raise FormatError, "MIDI header is too short" if @chunk_end - @pos < 6
+      @format, @track_count, @division = read( 6 ).unpack( "n3" )
+      @pos = @chunk_end  # later versions may add header fields
+      raise FormatError, "format #{@format} MIDI files aren't supported" if @format > 1
+      raise FormatError, "MIDI division #{@division} has no ticks" if @division == 0 || ticks_per_second == 0
+      raw = []  # [tick, order, kind, note, velocity, channel], kind :tempo has the tempo in note
+      tracks = 0
+      tracks += 1 while tracks < @track_count && parse_track( raw )
+      @data = nil
+      @notes = timed( raw.sort_by{ |e| e[0, 2] } )
+    end
+
+    # time of the last event, seconds
+    def duration
+      @notes.empty? ? 0.0 : @notes.last.time
+    end
+
+    private
+
+    def read n
+      raise FormatError, "MIDI file is truncated" if @pos + n > @data.bytesize
+      @data.byteslice( @pos, n ).tap{ @pos += n }
+    end
+
+    def byte
+      raise FormatError, "MIDI file is truncated" if @pos >= @data.bytesize
+      @data.getbyte( @pos ).tap{ @pos += 1 }
+    end
+
+    # the next chunk's type, leaving @pos on its body (and @chunk_end after it)
+    def chunk
+      type, length = read( 8 ).unpack( "a4N" )
+      @chunk_end = @pos + length
+      type
+    end
+
+    def varlen
+      value = 0
+      begin
+        b = byte
+        value = (value << 7) | (b & 0x7f)
+      end while b & 0x80 != 0
+      value
+    end
+
+    def parse_track raw
+      type = chunk
+      unless type == "MTrk"  # unknown chunks are skipped
+        @pos = @chunk_end
+        return @pos < @data.bytesize && parse_track( raw )
+      end
+      tick, running = 0, nil
+      while @pos < @chunk_end
+        tick += varlen
+        b = byte
+        if b & 0x80 == 0  # running status: b is already the first data byte
+          raise FormatError, "running status with no status byte" unless running
+          @pos -= 1
+          status = running
+        else
+          status = b
+          running = b < 0xf0 ? b : nil  # only channel messages set it, meta and sysex cancel it
+        end
+        case status
+        when 0xff
+          type, length = byte, varlen
+          body = read( length )
+          raw << [tick, raw.size, :tempo, (body.unpack( "C3" ).inject( 0 ){ |t,c| t << 8 | c }), nil, nil] if type == 0x51
+          break if type == 0x2f  # end of track
+        when 0xf0, 0xf7
+          read( varlen )
+        else
+          kind, channel = status & 0xf0, status & 0x0f
+          a = byte
+          b = [0xc0, 0xd0].include?( kind ) ? nil : byte
+          if kind == 0x90 && b > 0
+            raw << [tick, raw.size, :on, a, b, channel]
+          elsif kind == 0x80 || kind == 0x90
+            raw << [tick, raw.size, :off, a, 0, channel]
+          end
+        end
+      end
+      @pos = @chunk_end
+      true
+    end
+
+    # SMPTE divisions: frames a second (stored negative) times ticks a
+    # frame; nil for ticks a quarter
+    def ticks_per_second
+      -([@division >> 8].pack( "C" ).unpack1( "c" )) * (@division & 0xff) if @division & 0x8000 != 0
+    end
+
+    # ticks to seconds, following tempo changes in tick order
+    def timed raw
+      per_second = ticks_per_second
+      tempo, last_tick, seconds = DEFAULT_TEMPO, 0, 0.0
+      raw.each_with_object( [] ) do |(tick, _, kind, note, velocity, channel), notes|
+        seconds += (tick - last_tick) * (per_second ? 1.0 / per_second : tempo * 1e-6 / @division)
+        last_tick = tick
+        if kind == :tempo
+          tempo = note
+        else
+          notes << Event.new( seconds, kind, note, velocity, channel )
+        end
+      end
+    end
+  end
+
+end
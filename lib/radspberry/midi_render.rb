@@ -0,0 +1,35 @@
+# bounces Standard MIDI Files to wav through a polyphonic instrument: the
+# block builds one voice, a DSP::Poly pools them, and a DSP::Sequencer
+# plays the notes on their samples. rendering streams to the file a block
+# at a time; run_all spreads many files over forked workers like any
+# Pipeline.
+#
+#   bounce = MidiRender.new(:voices => 16, :format => :pcm16) { DSP::SuperSaw.new }
+#   bounce.run("song.mid", "song.wav")
+#   bounce.run_all(Dir["arrangements/*.mid"], "bounces", :workers => 8)
+#
+# :adsr is the voice envelope, :gain scales the mix and :tail (seconds,
+# default 1) renders past the last event so releases can ring out.
+class MidiRender < Pipeline
+  def initialize(opts = {}, &voice)
+    super(opts.reverse_merge(:voices => 16, :adsr => [0.005, 0.1, 0.8, 0.2], :gain => 0.25, :tail => 1.0), &voice)
+  end
+
+  def run(source, output)
+    start = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    smf  = MIDI::SMF.read(source)
+    poly = DSP::Poly.new(@opts[:voices], @opts[:adsr], @opts[:gain], &@graph)
+    seq  = DSP::Sequencer.new(poly, :capacity => [smf.notes.size, 16].max)
+    smf.notes.each do |e|
+      e.kind == :on ? seq.note(e.time, e.note, e.velocity, nil, e.channel) : seq.note_off(e.time, e.note, e.channel)
+    end
+    frames = ((smf.duration + @opts[:tail]) * DSP::Base.sampleRate).ceil
+    out = DSP::VirtualTime::Writer.new(output, @opts)
+    begin
+      frames.step(1, -@opts[:block]) { |left| out << seq.ticks([left, @opts[:block]].min).to_a }
+    ensure
+      out.close  # a failed render still leaves a well-formed file and frees the handle
+    end
+    Result.new(source, output, frames, DSP::Base.sampleRate.to_i, Process.clock_gettime(Process::CLOCK_MONOTONIC) - start)
+  end
+end
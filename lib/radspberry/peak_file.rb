@@ -0,0 +1,191 @@
+# multi-resolution waveform overview of an audio file: min, max and rms
+# per bin at a few zoom levels (256, 4096 and 65536 frames per bin by
+# default), kept in a small sidecar next to the audio. a viewer maps the
+# sidecar and reads just the bins it draws, so zooming around a multi-hour
+# render touches a few KB instead of the whole wav.
+#
+# build it while rendering (the Recorder does with :peaks => true):
+#
+#   peaks = PeakFile.new("take1.wav.peaks", 1, 44100)
+#   peaks << block  # interleaved floats, any block size
+#   peaks.finish
+#
+# or afterwards, in the background:
+#
+#   PeakFile.spawn("take1.wav")
+#   PeakFile.open("take1.wav.peaks").view(0, 44100 * 3600, 800)  # 800 [min, max, rms]
+#
+# layout: 64 byte header (magic, channels, levels, rate, frames), a 16 byte
+# entry per level (frames per bin, bins, offset) and each level's bins as
+# float32 min, max, rms per channel, coarsest last.
+class PeakFile
+  MAGIC       = "RSPPEAK1"
+  HEADER      = 64
+  HEADER_FMT  = "a8VVEQ<"
+  LEVEL       = 16
+  LEVEL_FMT   = "VQ<V"
+  LEVELS      = [256, 4096, 65536]
+  BLOCK       = 16384  # frames per read when building from a file
+
+  def self.sidecar(path)
+    "#{path}.peaks"
+  end
+
+  attr_reader :path, :channels, :sample_rate, :frames, :levels
+
+  # a writer; levels must each be a multiple of the one before
+  def initialize(path, channels, sample_rate, levels = LEVELS)
+    raise ArgumentError, "each level must be a multiple of the one before" unless
+      levels.each_cons(2).all? { |a, b| b % a == 0 }
+    @path, @channels, @sample_rate, @levels = path, channels, sample_rate, levels
+    @frames = 0
+    @bins   = levels.map { "".b }  # packed float32 triplets, per level
+    @acc    = levels.map { new_acc }
+    @count  = Array.new(levels.size, 0)  # frames in each level's open bin
+    @pos    = 0  # channel of the next sample, blocks may split frames
+  end
+
+  def <<(samples)
+    base = @levels[0]
+    acc  = @acc[0]
+    samples.each do |s|
+      a = acc[@pos]
+      a[0] = s if s < a[0]
+      a[1] = s if s > a[1]
+      a[2] += s * s
+      if (@pos += 1) == @channels
+        @pos = 0
+        @frames += 1
+        close_bin(0) if (@count[0] += 1) == base
+      end
+    end
+    self
+  end
+
+  def finish
+    @levels.each_index { |l| close_bin(l) if @count[l] > 0 }
+    offset = HEADER + LEVEL * @levels.size
+    File.open(@path + ".tmp", "wb") do |file|
+      file.write([MAGIC, @channels, @levels.size, @sample_rate.to_f, @frames].pack(HEADER_FMT).ljust(HEADER, "\0"))
+      @levels.each_with_index do |spb, l|
+        file.write([spb, @bins[l].bytesize / bin_bytes, offset].pack(LEVEL_FMT).ljust(LEVEL, "\0"))
+        offset += @bins[l].bytesize
+      end
+      @bins.each { |b| file.write(b) }
+    end
+    File.rename(@path + ".tmp", @path)  # readers never see a half written sidecar
+    self
+  end
+
+  # reads any wav or flac in blocks and writes its sidecar
+  def self.generate(audio_path, levels = LEVELS)
+    probe = RiffFile.probe(audio_path) || FlacFile.probe(audio_path) or
+      raise ArgumentError, "#{audio_path} is not a wav or flac file"
+    reader = RiffFile.probe(audio_path) ? RiffFile : FlacFile
+    peaks = new(sidecar(audio_path), probe.channels, probe.sample_rate, levels)
+    reader.new(audio_path, 'r') do |audio|
+      scale = 1.0 / audio.full_scale
+      blocks = reader == RiffFile ? audio.each_block(BLOCK) : audio.each_block
+      blocks.each { |samples| peaks << samples.map { |s| s * scale } }
+    end
+    peaks.finish
+  end
+
+  # generate in a forked child (a thread where there is no fork), so an
+  # editor or the audio loop can carry on; returns a thread to join
+  def self.spawn(audio_path, levels = LEVELS)
+    return Thread.new { generate(audio_path, levels) } unless Process.respond_to?(:fork)
+    pid = fork do
+      begin
+        generate(audio_path, levels)
+      rescue StandardError => e
+        DSP::Log.warn "can't build peaks for %s: %s", audio_path, e.message
+        DSP::Log.flush
+      end
+      exit!(0)
+    end
+    Process.detach(pid)
+  end
+
+  def self.open(path)
+    Reader.new(path)
+  end
+
+  # maps a sidecar and reads bins straight out of it
+  class Reader
+    Level = Struct.new(:frames_per_bin, :bins, :offset)
+
+    attr_reader :channels, :sample_rate, :frames, :levels
+
+    def initialize(path)
+      @mem = DSP::SharedMemory.readonly(File.expand_path(path))  # expanded: a bare name would map into /dev/shm
+      magic, @channels, count, @sample_rate, @frames = @mem.read(0, HEADER).unpack(HEADER_FMT)
+      raise ArgumentError, "#{path} is not a peak file" unless magic == MAGIC
+      @levels = Array.new(count) { |l| Level.new(*@mem.read(HEADER + LEVEL * l, LEVEL).unpack(LEVEL_FMT)) }
+      @floats = 3 * @channels
+    end
+
+    def duration
+      @frames / @sample_rate
+    end
+
+    # the coarsest level that still has at least one bin per column
+    def level_for(frames_per_column)
+      @levels.reverse.find { |l| l.frames_per_bin <= frames_per_column } || @levels.first
+    end
+
+    # count bins of a level from first on, as [min, max, rms] per channel
+    def bins(level, first, count)
+      count = [count, level.bins - first].min
+      return [] if count <= 0
+      @mem.read(level.offset + 4 * @floats * first, 4 * @floats * count).unpack("e*").each_slice(3).each_slice(@channels).to_a
+    end
+
+    # width columns of [min, max, rms] covering frames from start on,
+    # read from the best level; channel 0 unless asked otherwise
+    def view(start, frames, width, channel = 0)
+      level = level_for(frames.to_f / width)
+      spb   = level.frames_per_bin
+      first = start / spb
+      data  = bins(level, first, (start + frames - 1) / spb - first + 1).map { |frame| frame[channel] }
+      Array.new(width) do |col|
+        a = (col * data.size) / width
+        b = [((col + 1) * data.size) / width, a + 1].max
+        cols = data[a...b] || []
+        next [0.0, 0.0, 0.0] if cols.empty?
+        [cols.map { |c| c[0] }.min, cols.map { |c| c[1] }.max, Math.sqrt(cols.inject(0.0) { |s, c| s + c[2] * c[2] } / cols.size)]
+      end
+    end
+
+    def close
+      @mem.close
+    end
+  end
+
+  private
+
+  def new_acc
+    Array.new(@channels) { [Float::INFINITY, -Float::INFINITY, 0.0] }
+  end
+
+  def bin_bytes
+    12 * @channels
+  end
+
+  # emits the current bin of level l and folds it into the next level up
+  def close_bin(l)
+    n = @count[l]
+    up = @acc[l + 1]
+    @acc[l].each_with_index do |(min, max, sq), ch|
+      @bins[l] << [min, max, Math.sqrt(sq / n)].pack("eee")
+      next unless up
+      u = up[ch]
+      u[0] = min if min < u[0]
+      u[1] = max if max > u[1]
+      u[2] += sq
+    end
+    @acc[l].each { |a| a[0], a[1], a[2] = Float::INFINITY, -Float::INFINITY, 0.0 }  # reset in place, << holds on to it
+    @count[l] = 0
+    close_bin(l + 1) if up && (@count[l + 1] += n) == @levels[l + 1]
+  end
+end
@@ -0,0 +1,143 @@
+require 'etc'
+require 'fileutils'
+
+# streams audio files through a processor graph into new files, a block
+# at a time, so memory stays constant however long the file. the block
+# builds a fresh graph (one per channel) for every file, after the sample
+# rate has been set to the file's; many files are spread over forked
+# workers. without fork they run one after another: the sample rate is
+# global, so threads would change it under each other.
+#
+#   hp = Pipeline.new(:format => :pcm24) { DSP::ProcessorChain[DSP::Hpf.new(80), DSP::ZDLP.new(12000)] }
+#   hp.run("take1.wav", "take1-hp.wav")
+#   hp.run_all(Dir["takes/*.wav"], "filtered", :workers => 4)
+#
+# output is float unless :format asks for :pcm16 or :pcm24, which go
+# through a Quantizer. :tail => seconds keeps processing silence after the
+# end of the input, for reverb or filter ringing.
+class Pipeline
+  FORMATS = DSP::Recorder::FORMATS
+  BLOCK   = 4096  # frames per block
+
+  Result = Struct.new(:source, :output, :frames, :sample_rate, :elapsed) do
+    def realtime_factor
+      elapsed > 0 ? frames / sample_rate.to_f / elapsed : Float::INFINITY
+    end
+  end
+
+  def initialize(opts = {}, &graph)
+    raise ArgumentError, "pass a block that builds the processor graph" unless graph
+    @opts  = opts.reverse_merge(:format => :float, :tail => 0, :block => BLOCK, :dither => true, :shape => false)
+    raise ArgumentError, "unknown format #{@opts[:format]}, choose from #{FORMATS.keys}" unless FORMATS[@opts[:format]]
+    @graph = graph
+  end
+
+  def run(source, output)
+    start = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    probe = RiffFile.probe(source) || FlacFile.probe(source) or
+      raise ArgumentError, "#{source} is not a wav or flac file"
+    reader = RiffFile.probe(source) ? RiffFile : FlacFile
+    channels, rate = probe.channels, probe.sample_rate
+    previous_rate = DSP::Base.sampleRate
+    DSP::Base.sampleRate = rate.to_f
+    graphs = Array.new(channels) { @graph.call }
+    bits, audio_format = FORMATS[@opts[:format]]
+    quantizer = DSP::Quantizer.new(bits, :channels => channels, :dither => @opts[:dither], :shape => @opts[:shape]) unless
+      audio_format == RiffFile::FORMAT_FLOAT
+    frames = 0
+
+    RiffFile.new(output, "wb+") do |out|
+      out.begin_data(channels, rate, bits, audio_format)
+      write = lambda do |samples|
+        samples = process(graphs, samples)
+        out.append_data(quantizer ? quantizer.pack(samples) : out.pack_samples(samples, bits, audio_format))
+        frames += samples.size / channels
+      end
+      reader.new(source, 'r') do |audio|
+        scale = 1.0 / audio.full_scale
+        blocks = reader == RiffFile ? audio.each_block(@opts[:block]) : audio.each_block
+        blocks.each { |samples| write.call(samples.map { |s| s * scale }) }
+      end
+      tail = (@opts[:tail] * rate).to_i
+      0.step(tail - 1, @opts[:block]) { |f| write.call(Array.new([@opts[:block], tail - f].min * channels, 0.0)) }
+      out.finish_data
+    end
+    Result.new(source, output, frames, rate, Process.clock_gettime(Process::CLOCK_MONOTONIC) - start)
+  ensure
+    DSP::Base.sampleRate = previous_rate if previous_rate
+  end
+
+  # runs every source into dir (same basename, as .wav), in parallel.
+  # returns a Result per file, in order; files that fail are logged and
+  # left out. sources that would share an output raise ArgumentError
+  def run_all(sources, dir, opts = {})
+    workers = opts[:workers] || Etc.nprocessors
+    jobs = sources.map { |s| [s, File.join(dir, File.basename(s, ".*") + ".wav")] }
+    clashes = jobs.group_by(&:last).select { |_, js| js.size > 1 }
+    unless clashes.empty?
+      raise ArgumentError, "sources would overwrite each other: " +
+        clashes.map { |o, js| "#{js.map(&:first).join(', ')} -> #{o}" }.join("; ")
+    end
+    FileUtils.mkdir_p(dir)
+    if workers < 2 || jobs.size < 2 || !Process.respond_to?(:fork)
+      return jobs.map { |s, o| attempt(s, o) }.compact
+    end
+    slices = Array.new([workers, jobs.size].min) { |i| (i...jobs.size).step(workers).to_a }
+    run_forked(jobs, slices).reject { |_, r| r.nil? }.sort_by(&:first).map(&:last)
+  end
+
+  private
+
+  def attempt(source, output)
+    run(source, output)
+  rescue SystemCallError, ArgumentError => e
+    DSP::Log.warn "can't process %s: %s", source, e.message
+    nil
+  rescue StandardError => e  # a graph bug on one file shouldn't take the rest down
+    DSP::Log.error "can't process %s: %s (%s)", source, e.message, e.class
+    nil
+  end
+
+  # deinterleaves, runs each channel through its graph, interleaves again.
+  # both shuffles are one values_at over index lists cached per block size
+  def process(graphs, samples)
+    return graphs[0].ticks(samples).to_a if graphs.size == 1
+    split, merge = shuffles(graphs.size, samples.size)
+    outs = graphs.each_with_index.map { |g, c| g.ticks(samples.values_at(*split[c])).to_a }
+    outs.flatten(1).values_at(*merge)
+  end
+
+  def shuffles(channels, size)
+    @shuffles ||= {}
+    @shuffles[[channels, size]] ||= begin
+      frames = size / channels
+      [Array.new(channels) { |c| (c...size).step(channels).to_a },
+       Array.new(size) { |i| (i % channels) * frames + i / channels }]
+    end
+  end
+
+  def run_forked(jobs, slices)
+    slices.map do |slice|
+      reader, writer = IO.pipe
+      pid = fork do
+        reader.close
+        writer.write Marshal.dump(slice.map { |i| [i, attempt(*jobs[i]).to_a] })
+        DSP::Log.flush
+        writer.close
+        exit!(0)
+      end
+      writer.close
+      [pid, reader, slice]
+    end.flat_map do |pid, reader, slice|
+      data = reader.read  # drain before wait, so big results can't stall the pipe
+      reader.close
+      Process.wait(pid)
+      begin
+        Marshal.load(data).map { |i, row| [i, row.empty? ? nil : Result.new(*row)] }
+      rescue ArgumentError, TypeError  # the worker died before writing its results
+        DSP::Log.warn "pipeline worker exited with %s, left out: %s", $?.inspect, jobs.values_at(*slice).map(&:first).join(", ")
+        []
+      end
+    end
+  end
+end
@@ -1,3 +1,5 @@
+require 'matrix'
+
 module ArrayExtensions
 
   def to_v
@@ -48,6 +50,7 @@ module ModuleExtensions
   def param_accessor symbol, opts={}, &block
     opts = { :range => opts } if opts.is_a?(Range)
     opts.reverse_merge! :range => (0..1)
+    (@param_ranges ||= {})[symbol] = opts[:range] || nil
     var = nil
     if d = opts[:delegate]
       d = "@#{d}" if d.is_a?(Symbol)      
@@ -79,6 +82,18 @@ module ModuleExtensions
     else
       module_eval "def #{symbol}=(val) #{var} = val; end"
     end
+
+    ## per-sample values for the next ticks, for classes that take them
+    module_eval "attr_writer :#{symbol}_buffer" if opts[:audio_rate]
+  end
+
+  # names declared with param_accessor here and in ancestors, with their range (nil if unclamped)
+  def param_ranges
+    ancestors.reverse.inject({}){ |all,a| all.merge( a.instance_variable_get(:@param_ranges) || {} ) }
+  end
+
+  def param_names
+    param_ranges.keys
   end
 end
 
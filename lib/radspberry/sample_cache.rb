@@ -0,0 +1,161 @@
+require 'digest/sha1'
+require 'fileutils'
+
+# decoded samples shared between render workers. the first worker to ask
+# for a file converts it once into a canonical float32 file (interleaved,
+# at the sample rate asked for) and every worker then maps that file
+# read-only, so N workers hold one copy in the page cache instead of N
+# decoded arrays. entries are keyed by source path, mtime, size and rate:
+# touching the source makes a new entry, and #prune drops the stale ones.
+#
+#   cache = SampleCache.new
+#   ir = cache.fetch("irs/hall.wav", 48000)
+#   ir.read(0, 1024)  # interleaved floats, straight out of the mapping
+#
+# the cache lives in /dev/shm (RADSPBERRY_CACHE overrides it), which is
+# memory that stays put between runs without ever hitting a disk.
+class SampleCache
+  MAGIC      = "RSPCACHE"
+  HEADER     = 64
+  HEADER_FMT = "a8VQ<EEQ<"     # magic, channels, frames, rate, source mtime, source size
+  BLOCK      = 16384           # frames per read while converting
+
+  attr_reader :dir
+
+  def initialize(dir = ENV['RADSPBERRY_CACHE'] || File.join(DSP::SharedMemory::DIR, "radspberry-cache"))
+    @dir = File.expand_path(dir)
+    FileUtils.mkdir_p(@dir)
+  end
+
+  def path_for(source, rate)
+    stat = File.stat(source)
+    key = Digest::SHA1.hexdigest([File.expand_path(source), stat.mtime.to_f, stat.size, rate.to_f].join("\0"))
+    File.join(@dir, "#{key}.f32")
+  end
+
+  # the decoded source at rate (its own rate when nil), built on first use.
+  # workers racing for the same entry take a lock, so it's built once
+  def fetch(source, rate = nil)
+    rate ||= (RiffFile.probe(source) || FlacFile.probe(source) or
+              raise ArgumentError, "#{source} is not a wav or flac file").sample_rate
+    file = path_for(source, rate)
+    unless File.exist?(file)
+      File.open(file + ".lock", File::RDWR | File::CREAT, 0600) do |lock|
+        lock.flock(File::LOCK_EX)
+        build(source, rate, file) unless File.exist?(file)  # someone else may have built it meanwhile
+      end
+      File.unlink(file + ".lock") rescue nil
+    end
+    Sample.new(file)
+  end
+
+  # removes entries whose source has changed or gone away
+  def prune
+    removed = 0
+    Dir[File.join(@dir, "*.f32")].each do |file|
+      entry = Sample.new(file).tap(&:close)
+      next if entry.source && File.exist?(entry.source) && path_for(entry.source, entry.sample_rate) == file
+      File.unlink(file)
+      removed += 1
+    end
+    removed
+  end
+
+  def clear
+    FileUtils.rm_f(Dir[File.join(@dir, "*.f32")])
+  end
+
+  # a read-only view of one cache entry
+  class Sample
+    attr_reader :path, :channels, :frames, :sample_rate, :source
+
+    def initialize(path)
+      @path = path
+      @mem  = DSP::SharedMemory.readonly(path)
+      magic, @channels, @frames, @sample_rate = @mem.read(0, HEADER).unpack(HEADER_FMT)
+      raise ArgumentError, "#{path} is not a sample cache entry" unless magic == MAGIC
+      @source = @mem.read(HEADER + 4 * @channels * @frames, @mem.size - HEADER - 4 * @channels * @frames)
+      @source = nil if @source.empty?
+    end
+
+    def duration
+      @frames / @sample_rate
+    end
+
+    # count interleaved frames from frame on
+    def read(frame, count)
+      count = [count, @frames - frame].min
+      return [] if count <= 0
+      @mem.get_floats(HEADER + 4 * @channels * frame, @channels * count)
+    end
+
+    def to_a
+      read(0, @frames)
+    end
+
+    def each_block(frames = BLOCK)
+      return enum_for(:each_block, frames) unless block_given?
+      0.step(@frames - 1, frames) { |f| yield read(f, frames) }
+    end
+
+    def close
+      @mem.close
+    end
+  end
+
+  private
+
+  def build(source, rate, file)
+    probe = RiffFile.probe(source) || FlacFile.probe(source) or
+      raise ArgumentError, "#{source} is not a wav or flac file"
+    reader = RiffFile.probe(source) ? RiffFile : FlacFile
+    resampler = Resampler.new(probe.channels, probe.sample_rate.to_f / rate) unless rate == probe.sample_rate
+    frames = 0
+    File.open(file + ".tmp", "wb") do |out|
+      out.write("\0" * HEADER)
+      reader.new(source, 'r') do |audio|
+        scale = 1.0 / audio.full_scale
+        blocks = reader == RiffFile ? audio.each_block(BLOCK) : audio.each_block
+        blocks.each do |samples|
+          samples = samples.map { |s| s * scale }
+          samples = resampler << samples if resampler
+          out.write(samples.pack("e*"))
+          frames += samples.size / probe.channels
+        end
+      end
+      out.write(File.expand_path(source))  # trailer, for prune
+      stat = File.stat(source)
+      out.seek(0)
+      out.write([MAGIC, probe.channels, frames, rate.to_f, stat.mtime.to_f, stat.size].pack(HEADER_FMT))
+    end
+    File.rename(file + ".tmp", file)  # readers only ever see finished entries
+  end
+
+  # streaming linear interpolation, step source frames per output frame
+  class Resampler
+    def initialize(channels, step)
+      @channels, @step = channels, step
+      @pos  = 0.0                       # next output position, in source frames
+      @last = Array.new(channels, 0.0)  # the frame before this block
+      @base = -1                        # source index of @last
+    end
+
+    def <<(samples)
+      ch = @channels
+      n  = samples.size / ch
+      out = []
+      while (i = @pos.floor) < @base + n  # need frames i and i + 1
+        t = @pos - i
+        ch.times do |c|
+          a = i <= @base ? @last[c] : samples[(i - @base - 1) * ch + c]
+          b = samples[(i - @base) * ch + c]
+          out << a + (b - a) * t
+        end
+        @pos += @step
+      end
+      @last = samples[(n - 1) * ch, ch] if n > 0
+      @base += n
+      out
+    end
+  end
+end
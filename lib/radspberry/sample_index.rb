@@ -0,0 +1,165 @@
+require 'etc'
+
+# persistent index of a sample library: format, length, peak and rms of
+# every wav under some directories, so tools don't have to reopen each
+# file. scans are incremental (only new files, or files whose mtime or
+# size changed, get analyzed) and the analysis is spread over forked
+# workers, or threads where fork isn't available.
+#
+#   index = SampleIndex.new( "samples.idx" )
+#   index.scan( "~/samples" )
+#   index.select{ |e| e.channels == 2 && e.duration < 1.0 }
+class SampleIndex
+  include Enumerable
+
+  FORMAT_VERSION = 1
+  PATTERN        = "**/*.wav"
+
+  Entry = Struct.new(:path, :mtime, :size, :audio_format, :channels, :sample_rate,
+                     :bit_depth, :frames, :peak, :rms) do
+    def duration
+      frames.to_f / sample_rate
+    end
+
+    def stale?(stat)
+      stat.mtime.to_f != mtime || stat.size != size
+    end
+  end
+
+  attr_reader :file, :workers
+
+  def initialize(file, opts = {})
+    @file    = File.expand_path(file)
+    @workers = opts[:workers] || Etc.nprocessors
+    @entries = {}
+    load if File.exist?(@file)
+  end
+
+  # analyzes one file: probe plus a streaming peak/rms pass over the data.
+  # peak and rms are linear, relative to full scale
+  def self.analyze(path)
+    stat  = File.stat(path)
+    probe = RiffFile.probe(path) or return nil
+    peak = sum = 0.0
+    count = 0
+    RiffFile.new(path, 'r') do |wav|
+      format = wav.format
+      unless format && format.num_channels > 0 && format.block_align > 0  # each_block divides by both
+        raise ArgumentError, "bad fmt chunk"
+      end
+      scale = 1.0 / wav.full_scale
+      wav.each_block(16384) do |samples|
+        samples.each do |s|
+          v = s * scale
+          peak = v.abs if v.abs > peak
+          sum += v * v
+        end
+        count += samples.size
+      end
+    end
+    rms = count > 0 ? Math.sqrt(sum / count) : 0.0
+    Entry.new(path, stat.mtime.to_f, stat.size, *probe.to_a, peak, rms)
+  rescue SystemCallError, ArgumentError => e  # unreadable or malformed
+    DSP::Log.warn "can't index %s: %s", path, e.message
+    nil
+  end
+
+  def [](path)
+    @entries[File.expand_path(path)]
+  end
+
+  def each(&block)
+    @entries.each_value(&block)
+  end
+
+  def size
+    @entries.size
+  end
+
+  # brings the index up to date with everything matching PATTERN under dirs
+  # and saves it. returns counts of what changed
+  def scan(*dirs)
+    found = dirs.flat_map do |dir|
+      dir = File.expand_path(dir)
+      Dir.glob(PATTERN, File::FNM_CASEFOLD, base: dir).map { |f| File.join(dir, f) }
+    end
+    stale = found.select do |path|
+      entry = @entries[path]
+      entry.nil? || entry.stale?(File.stat(path))
+    end
+    roots = dirs.map { |dir| File.join(File.expand_path(dir), "") }
+    gone  = @entries.keys.select { |path| roots.any? { |r| path.start_with?(r) } } - found
+
+    gone.each { |path| @entries.delete(path) }
+    analyze_all(stale).each { |entry| @entries[entry.path] = entry }
+    save
+    DSP::Log.info "indexed %d files (%d analyzed, %d removed)", found.size, stale.size, gone.size
+    { :files => found.size, :analyzed => stale.size, :removed => gone.size }
+  end
+
+  # rows of plain values, marshaled: small and quick to load.
+  # written to a temp file and renamed so readers never see half an index
+  def save
+    rows = @entries.values.map(&:to_a)
+    tmp  = "#{@file}.#{Process.pid}.tmp"
+    File.binwrite(tmp, Marshal.dump([FORMAT_VERSION, rows]))
+    File.rename(tmp, @file)
+  end
+
+  def load
+    version, rows = Marshal.load(File.binread(@file))
+    return unless version == FORMAT_VERSION  # stale format, rebuild on scan
+    @entries = rows.each_with_object({}) { |row, h| h[row.first] = Entry.new(*row) }
+  end
+
+  private
+
+  def analyze_all(paths)
+    return analyze_slice(paths) if @workers < 2 || paths.size < 2
+    slices = Array.new([@workers, paths.size].min) { |i| paths.values_at(*(i...paths.size).step(@workers)) }
+    Process.respond_to?(:fork) ? analyze_forked(slices) : analyze_threaded(slices)
+  end
+
+  def analyze_forked(slices)
+    slices.map do |slice|
+      reader, writer = IO.pipe
+      pid = fork do
+        reader.close
+        writer.write Marshal.dump(analyze_slice(slice).map(&:to_a))
+        writer.close
+        DSP::Log.flush
+        exit!(0)
+      end
+      writer.close
+      [pid, reader]
+    end.flat_map do |pid, reader|
+      data = reader.read  # drain before wait, so big results can't stall the pipe
+      reader.close
+      Process.wait(pid)
+      begin
+        Marshal.load(data).map { |row| Entry.new(*row) }
+      rescue ArgumentError, TypeError  # the worker died before writing all of it
+        DSP::Log.warn "index worker %d exited with %s, its files are retried on the next scan", pid, $?.inspect
+        []
+      end
+    end
+  end
+
+  def analyze_threaded(slices)
+    slices.map do |slice|
+      Thread.new { analyze_slice(slice) }
+    end.flat_map(&:value)
+  end
+
+  # a bug tripped by one odd file only loses that file, not the whole slice
+  def analyze_slice(paths)
+    paths.map do |path|
+      begin
+        self.class.analyze(path)
+      rescue StandardError => e
+        DSP::Log.error "can't index %s: %s (%s)", path, e.message, e.class
+        nil
+      end
+    end.compact
+  end
+end
@@ -0,0 +1,27 @@
+require "test/unit"
+require "radspberry/core"
+
+# shared by the DSP tests: include it to run each test at one sample per
+# millisecond (so seconds read as sample counts) and get the Dc fixture.
+# a test class with its own setup or teardown calls super.
+module TestHelper
+  RATE = 1000.0
+
+  # a constant source; level is a param so ParamMap and the sequencer can
+  # set it, freq is there for note_on
+  class Dc < DSP::Generator
+    param_accessor :level, :range => false
+    attr_accessor :freq
+    def initialize level=1.0; @level = level; end
+    def tick; @level; end
+  end
+
+  def setup
+    @previous_rate = DSP::Base.sampleRate
+    DSP::Base.sampleRate = RATE
+  end
+
+  def teardown
+    DSP::Base.sampleRate = @previous_rate
+  end
+end
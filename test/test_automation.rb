@@ -0,0 +1,52 @@
+require_relative "helper"
+
+class TestAutomation < Test::Unit::TestCase
+  include DSP
+  include TestHelper
+
+  def test_lane_curves
+    lane = Automation::Lane.new( nil, [[0.1, 1.0], [0.2, 2.0], [0.3, 8.0, :exp], [0.4, 0.0, :step]] )
+    assert_equal 1.0, lane.value_at( 0 )  # holds before the first point
+    assert_in_delta 1.5, lane.value_at( 150 ), 1e-12
+    assert_in_delta 4.0, lane.value_at( 250 ), 1e-12
+    assert_equal 8.0, lane.value_at( 399 )
+    assert_equal 0.0, lane.value_at( 400 )
+    assert_equal 0.0, lane.value_at( 10_000 )
+    assert_in_delta 1.5, lane.value_at( 150 ), 1e-12  # seeking back
+    assert_equal 100, lane.until_next( 0 )
+    assert_equal 30, lane.until_next( 170 )
+    assert_raise( ArgumentError ){ lane.add( 1, 1, :cubic ) }
+  end
+
+  def test_blocks_split_on_breakpoints
+    saw  = SuperSaw.new
+    auto = Automation.new( saw, 64 )
+    auto.lane "mix", [[0, 0.0], [0.037, 0.0], [0.037, 1.0, :step]]
+    seen = []
+    saw.define_singleton_method( :ticks ){ |n| seen << [n, mix]; super( n ) }
+    auto.ticks( 100 )
+    assert_equal [[37, 0.0], [27, 1.0], [36, 1.0]], seen  # breakpoint, then back on the grid
+    assert_in_delta 0.1, auto.position, 1e-12
+  end
+
+  def test_audio_rate_ramps
+    fader = XFader.new( Dc.new( 0.0 ), Dc.new( 1.0 ), 0.0 )
+    auto  = Automation.new( fader )
+    auto.lane "fade", [[0, 0.0], [0.01, 1.0]]
+    out = auto.ticks( 12 ).to_a
+    assert_equal (0..9).map{ |i| i / 10.0 } + [1.0, 1.0], out.map{ |v| v.round( 12 ) }
+  end
+
+  def test_live_and_offline_agree
+    render = lambda do |chunks|
+      fader = XFader.new( Dc.new( -1.0 ), Dc.new( 1.0 ), 0.0 )
+      auto  = Automation.new( fader )
+      auto.lane "fade", [[0.01, 0.0], [0.05, 1.0], [0.07, 0.25, :step]]
+      chunks.flat_map{ |n| auto.ticks( n ).to_a }
+    end
+    whole = render.call( [100] )
+    assert_equal whole, render.call( [13, 1, 50, 36] )
+    assert_equal 0.0, whole[30]
+    assert_equal( -0.5, whole[70] )
+  end
+end
@@ -0,0 +1,65 @@
+require "test/unit"
+require "radspberry/core"
+
+class TestConvolver < Test::Unit::TestCase
+  include DSP
+
+  def direct ir, x
+    Array.new( x.size ){ |t| (0..[t, ir.size - 1].min).inject( 0.0 ){ |s,k| s + ir[k] * x[t - k] } }
+  end
+
+  def run_in_odd_chunks conv, x
+    out = []
+    pos = 0
+    [7, 1, 50, 16, 33, 200].cycle do |n|
+      break if pos >= x.size
+      out.concat conv.ticks( x[pos, n] )
+      pos += n
+    end
+    out
+  end
+
+  def test_matches_direct_convolution_with_zero_latency
+    ir = Array.new( 1500 ){ |i| DSP.noise * ::Math.exp( -i / 300.0 ) }
+    x  = Array.new( 2000 ){ DSP.noise }
+    expected = direct( ir, x )
+    [false, true].each do |threads|
+      conv = Convolver.new( ir, :block => 16, :growth => 4, :threads => threads )
+      assert_equal [16, 64, 256], conv.levels.map(&:size)
+      got = run_in_odd_chunks( conv, x )
+      assert_operator got.zip( expected ).map{ |a,b| (a - b).abs }.max, :<, 1e-9
+      conv.close
+    end
+  end
+
+  def test_capped_partitions_and_clear
+    ir = Array.new( 600 ){ DSP.noise }
+    x  = Array.new( 800 ){ DSP.noise }
+    conv = Convolver.new( ir, :block => 8, :growth => 4, :max_partition => 32, :threads => true )
+    assert_equal [8, 32], conv.levels.map(&:size)
+    conv.ticks( x.reverse )
+    conv.clear
+    got = conv.ticks( x )
+    assert_operator got.zip( direct( ir, x ) ).map{ |a,b| (a - b).abs }.max, :<, 1e-9
+    conv.close
+  end
+
+  def test_worker_errors_reach_the_audio_side
+    conv = Convolver.new( Array.new( 600 ){ DSP.noise }, :block => 8, :growth => 4, :max_partition => 32 )
+    level = conv.levels.find( &:threaded? )
+    def level.compute frame
+      raise FloatDomainError, "bad ir"
+    end
+    error = assert_raise( FloatDomainError ){ conv.ticks( Array.new( 200, 0.5 ) ) }
+    assert_equal "bad ir", error.message
+    assert_raise( FloatDomainError ){ conv.ticks( Array.new( 200, 0.5 ) ) }  # and keeps failing, instead of hanging
+  end
+
+  def test_close_stops_the_workers
+    conv = Convolver.new( Array.new( 600 ){ DSP.noise }, :block => 8, :growth => 4, :max_partition => 32 )
+    workers = conv.levels.map{ |l| l.instance_variable_get( :@worker ) }.compact
+    assert_equal 1, workers.size
+    conv.close
+    assert workers.all?{ |w| w.join( 1 ) && !w.alive? }
+  end
+end
@@ -0,0 +1,89 @@
+require_relative "helper"
+
+class TestEnvelope < Test::Unit::TestCase
+  include DSP
+  include TestHelper
+
+  def test_adsr_stages_land_on_their_levels
+    env = Envelope.adsr( 0.01, 0.02, 0.5, 0.01 )
+    assert env.idle?
+    env.trigger
+    out = env.ticks( 50 ).to_a
+    assert_in_delta 1.0, out[9], 1e-12   # attack ends on 1
+    assert_in_delta 0.5, out[29], 1e-12  # decay ends on sustain
+    assert_equal [0.5] * 20, out[30..-1]
+    assert out[0, 10].each_cons( 2 ).all?{ |a,b| b > a }
+    env.release
+    out = env.ticks( 20 ).to_a
+    assert_in_delta 0.0, out[9], 1e-12
+    assert_equal [0.0] * 10, out[10..-1]
+    assert env.idle?
+  end
+
+  def test_release_without_release_segments_fades_to_zero
+    ad = Envelope.ad( 0.01, 0.1 )
+    ad.trigger
+    ad.ticks( 20 )
+    ad.release  # mid-decay: no sustain index
+    out = ad.ticks( 20 ).to_a
+    assert_operator out[0], :<, 0.9
+    assert_in_delta 0.0, out[9], 1e-12  # RELEASE is 10 samples here
+    assert ad.idle?
+
+    held = Envelope.new( [[1.0, 0.005], [0.5, 0.005]], 1 )  # sustains on its last segment
+    held.trigger
+    held.ticks( 20 )
+    held.release
+    assert_in_delta 0.0, held.ticks( 10 ).to_a.last, 1e-12
+    assert held.idle?
+  end
+
+  def test_one_shots_hold_their_last_level_until_released
+    env = Envelope.new( [[0.8, 0.005, Envelope::LINEAR]] )
+    env.trigger
+    assert_equal [0.8] * 5, env.ticks( 10 ).to_a[5..-1]
+    assert_equal [0.8] * 10, env.ticks( 10 ).to_a
+  end
+
+  def test_triggers_are_sample_accurate
+    env = Envelope.adsr( 0.005, 0.005, 1.0, 0.005 )
+    env.trigger( 0.5, 37 )
+    out = env.ticks( 64 ).to_a
+    assert_equal [0.0] * 37, out[0, 37]
+    assert_operator out[37], :>, 0.0
+    assert_in_delta 0.5, out[41], 1e-12  # velocity scales the levels
+    env.release( 70 )  # carries over into the following block
+    assert_equal [0.5] * 64, env.ticks( 64 ).to_a
+    out = env.ticks( 64 ).to_a
+    assert_equal [0.5] * 6, out[0, 6]
+    assert_operator out[6], :<, 0.5
+  end
+
+  def test_blocks_match_ticks
+    a, b = Envelope.adsr( 0.013, 0.021, 0.3, 0.017 ), Envelope.adsr( 0.013, 0.021, 0.3, 0.017 )
+    a.trigger; b.trigger
+    ticked = Array.new( 40 ){ a.tick }
+    blocks = b.ticks( 7 ).to_a + b.ticks( 33 ).to_a
+    ticked.zip( blocks ).each{ |x,y| assert_in_delta x, y, 1e-12 }
+  end
+
+  def test_retrigger_starts_from_the_current_level
+    env = Envelope.new( [[1.0, 0.01, Envelope::LINEAR]], 0 )
+    env.trigger
+    env.ticks( 5 )
+    env.trigger
+    out = env.ticks( 10 ).to_a
+    assert_in_delta 0.55, out[0], 1e-12  # no jump back to zero
+    assert_in_delta 1.0, out[9], 1e-12
+  end
+
+  def test_vca_scales_the_synth
+    dc  = Class.new( Generator ){ def tick; 1.0; end }.new
+    vca = VCA.new( dc, Envelope.ad( 0.002, 0.002 ) )
+    assert_equal [0.0] * 4, vca.ticks( 4 ).to_a
+    vca.env.trigger
+    out = vca.ticks( 6 ).to_a
+    assert_in_delta 1.0, out[1], 1e-12
+    assert_equal [0.0, 0.0], out[4, 2]
+  end
+end
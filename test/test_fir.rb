@@ -0,0 +1,49 @@
+require "test/unit"
+require "radspberry/core"
+
+class TestFIR < Test::Unit::TestCase
+  include DSP
+
+  def max_diff a, b
+    a.zip( b ).map{ |x,y| (x - y).abs }.max
+  end
+
+  def test_fft_roundtrip
+    x  = Array.new( 64 ){ DSP.noise }
+    re, im = FFT.spectrum( x, 64 )
+    FFT[64].inverse( re, im )
+    assert_operator max_diff( x, re ), :<, 1e-12
+    assert_operator im.map(&:abs).max, :<, 1e-12
+  end
+
+  def test_tick_block_and_fft_paths_agree
+    x = Array.new( 1000 ){ DSP.noise }
+    fir = FIR.new( Array.new( 150 ){ DSP.noise } )
+    ticked = x.map{ |v| fir.tick( v ) }
+    [10_000, 1].each do |threshold|  # direct, then fft
+      fir.clear
+      FIR.fft_threshold = threshold
+      blocks = fir.ticks( x[0, 300] ) + [fir.tick( x[300] )] + fir.ticks( x[301..-1] )
+      assert_operator max_diff( ticked, blocks ), :<, 1e-10
+    end
+  ensure
+    FIR.fft_threshold = 96
+  end
+
+  def test_designs
+    lp = FIR.lowpass( 2000, 101 )
+    assert_equal 50, lp.latency
+    assert_operator max_diff( lp.taps, lp.taps.reverse ), :<, 1e-15  # linear phase
+    assert_in_delta 1.0, lp.response( 0 ), 1e-9
+    assert_in_delta 0.5, lp.response( 2000 ), 0.01
+    assert_operator lp.response( 5000 ), :<, 1e-3
+
+    hp = FIR.highpass( 2000, 101 )
+    assert_operator hp.response( 0 ), :<, 1e-9
+    assert_in_delta 1.0, hp.response( 10000 ), 1e-3
+
+    shelf = FIR.least_squares( 63, [[0, 500], [1500, 22050]], [1.0, 0.25] )
+    assert_in_delta 1.0, shelf.response( 100 ), 0.05
+    assert_in_delta 0.25, shelf.response( 8000 ), 0.02
+  end
+end
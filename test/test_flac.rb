@@ -0,0 +1,67 @@
+require "test/unit"
+require "tmpdir"
+require "radspberry/core"
+
+class TestFlac < Test::Unit::TestCase
+
+  def setup
+    @dir = Dir.mktmpdir
+    @path = File.join(@dir, "test.flac")
+  end
+
+  def teardown
+    FileUtils.remove_entry @dir
+  end
+
+  def roundtrip channels, bit_depth, samples, opts={}
+    FlacFile.new(@path, "wb") do |flac|
+      flac.begin_data(channels, 44100, bit_depth, opts)
+      samples.each_slice(1000) { |s| flac.append_samples(s) }
+      flac.finish_data
+    end
+    decoded = nil
+    FlacFile.new(@path, "r") { |flac| decoded = flac.simple_read }
+    decoded
+  end
+
+  def test_lossless_mono
+    sine = 10000.times.map { |i| (Math.sin(i * 0.01) * 20000).round }
+    assert_equal sine, roundtrip(1, 16, sine)
+    assert File.size(@path) < sine.size  # well under half the 16 bit size
+  end
+
+  def test_lossless_stereo_on_background_thread
+    stereo = 5000.times.flat_map { |i| [(Math.sin(i * 0.01) * 1e6).round, rand(2**20) - 2**19] }
+    assert_equal stereo, roundtrip(2, 24, stereo, :threaded => true, :block_size => 1152)
+  end
+
+  def test_background_encoder_errors_reach_the_producer
+    flac = FlacFile.new(@path, "wb")
+    def flac.encode_block(_)
+      raise IOError, "disk full"
+    end
+    flac.begin_data(1, 44100, 16, :threaded => true, :queue => 1, :block_size => 16)
+    error = assert_raise(IOError) { 100.times { flac.append_samples([0] * 16) } }
+    assert_equal "disk full", error.message
+  ensure
+    flac.close
+  end
+
+  def test_probe
+    roundtrip(1, 16, [0] * 5000 + [1, -1] * 10)
+    assert_equal [RiffFile::FORMAT_PCM, 1, 44100, 16, 5020], FlacFile.probe(@path).to_a
+  end
+
+  def test_truncated_metadata_is_rejected
+    roundtrip(1, 16, [0] * 100)
+    data = File.binread(@path)
+    [6, 20].each do |size|  # inside a block header, inside STREAMINFO
+      File.binwrite(@path, data[0, size])
+      error = assert_raise(ArgumentError) { FlacFile.new(@path, "r") }
+      assert_equal "FLAC file is truncated", error.message
+    end
+    File.binwrite(@path, "fLaC" + [0x80000000 | 4].pack("N") + "\0" * 4)  # last block, a padding one
+    assert_raise(ArgumentError) { FlacFile.new(@path, "r") }
+  end
+
+end
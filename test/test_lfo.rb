@@ -0,0 +1,54 @@
+require_relative "helper"
+
+class TestLFO < Test::Unit::TestCase
+  include DSP
+  include TestHelper
+
+  def test_shapes_at_control_points
+    { :sine => [0.0, 1.0, 0.0, -1.0], :tri => [-1.0, 0.0, 1.0, 0.0],
+      :saw => [-1.0, -0.5, 0.0, 0.5], :square => [1.0, 1.0, -1.0, -1.0] }.each do |shape, expected|
+      lfo = LFO.new( 1.0, shape )  # 1000 samples a cycle
+      got = [lfo.value] + Array.new( 3 ){ lfo.advance( 250 ) }
+      got.zip( expected ).each{ |g,e| assert_in_delta e, g, 1e-12, shape.to_s }
+    end
+  end
+
+  def test_audio_rate_ramps_between_control_points
+    lfo = LFO.new( 1.0, :saw, :kperiod => 10 )
+    out = lfo.ticks( 25 ).to_a
+    assert_in_delta( -0.98, out[9], 1e-12 )  # lands on each control point
+    assert_in_delta( -0.96, out[19], 1e-12 )
+    out.each_cons( 2 ){ |a,b| assert_in_delta 0.002, b - a, 1e-12 }
+    ticked = LFO.new( 1.0, :saw, :kperiod => 10 )
+    Array.new( 25 ){ ticked.tick }.zip( out ).each{ |a,b| assert_in_delta a, b, 1e-12 }
+  end
+
+  def test_random_shapes_hold_for_a_cycle
+    lfo = LFO.new( 10.0, :sample_hold )  # 100 samples a cycle
+    held = lfo.value
+    assert_equal [held] * 4, Array.new( 4 ){ lfo.advance( 20 ) }
+    refute_equal held, lfo.advance( 20 )
+    smooth = LFO.new( 10.0, :smooth )
+    values = Array.new( 100 ){ smooth.advance( 1 ) }
+    values.each_cons( 2 ){ |a,b| assert_operator (b - a).abs, :<, 0.1 }
+  end
+
+  def test_tempo_sync
+    lfo = LFO.new( 1.0, :sine ).sync( 120, 2 )  # one cycle per two beats
+    assert_in_delta 1.0, lfo.freq, 1e-12
+    lfo.tempo = 90
+    assert_in_delta 0.75, lfo.freq, 1e-12
+    assert_raise( ArgumentError ){ LFO.new.tempo = 120 }
+    assert_raise( ArgumentError ){ LFO.new( 1.0, :wobble ) }
+  end
+
+  def test_sample_hold_and_glide
+    sh = SampleHold.new( 100.0, 0.0 )
+    steps = sh.ticks( 40 ).to_a.chunk{ |v| v }.map{ |v,run| run.size }
+    steps[0..-2].each{ |n| assert_in_delta 10, n, 1 }  # phase rounding may shift a step
+    glide = SampleGlide.new( 100.0 )
+    out = glide.ticks( 100 ).to_a
+    assert out.all?{ |v| v.abs <= 1.0 }
+    out.each_cons( 2 ){ |a,b| assert_operator (b - a).abs, :<, 0.5 }
+  end
+end
@@ -0,0 +1,69 @@
+require "test/unit"
+require "stringio"
+require "rbconfig"
+require "radspberry/core"
+
+class TestLog < Test::Unit::TestCase
+  include DSP
+
+  def setup
+    @level, @io = Log.level, Log.io
+    Log.level = :debug
+    Log.io = @out = StringIO.new
+  end
+
+  def teardown
+    Log.io = @io
+    Log.level = @level
+  end
+
+  def test_formats_args_and_falls_back_on_bad_formats
+    Log.info "wrote %d samples to %s", 64, "a.wav"
+    Log.warn "nil is a value: %p", nil
+    Log.error "%d is not a number", "x"
+    Log.flush
+    lines = @out.string.lines
+    assert_match(/\A\d+\.\d{6} \[INFO\] wrote 64 samples to a.wav$/, lines[0])
+    assert_match(/\[WARN\] nil is a value: nil$/, lines[1])
+    assert_match(/\[ERROR\] %d is not a number \["x"\]$/, lines[2])
+  end
+
+  def test_threshold
+    Log.level = :warn
+    assert_equal false, Log.info( "skipped" )
+    Log.flush
+    assert_equal "", @out.string
+    assert_raise( ArgumentError ){ Log.level = :loud }
+  end
+
+  def test_each_thread_gets_its_own_ring
+    threads = 4.times.map do |t|
+      Thread.new{ 100.times{ |i| Log.info "thread %d message %d", t, i } }
+    end
+    threads.each( &:join )
+    Log.flush
+    lines = @out.string.lines
+    assert_equal 400, lines.size
+    4.times{ |t| assert_equal 100, lines.grep( /thread #{t} / ).size }
+    times = lines.map{ |l| l.to_f }
+    assert_equal times.sort, times
+  end
+
+  def test_counts_and_reports_drops
+    before = Log.dropped
+    Log.class_variable_get( :@@lock ).synchronize do  # hold the writer off
+      Thread.new{ (Log::CAPACITY + 10).times{ Log.info "x" } }.join
+    end
+    Log.flush
+    assert_equal before + 10, Log.dropped
+    assert_match(/^\[log\] 10 messages dropped$/, @out.string)
+    assert_equal Log::CAPACITY, @out.string.lines.grep( /\[INFO\] x$/ ).size
+  end
+
+  def test_messages_from_later_exit_hooks_are_written
+    lib = File.expand_path( "../../lib", __FILE__ )
+    script = 'require "radspberry/core"; DSP::Log.level = :info; at_exit{ DSP::Log.info "closing" }'
+    err = IO.popen( [RbConfig.ruby, "-I", lib, "-e", script, :err => [:child, :out]], &:read )
+    assert_match(/\[INFO\] closing$/, err)
+  end
+end
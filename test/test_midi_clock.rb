@@ -0,0 +1,74 @@
+require_relative "helper"
+
+class TestMidiClock < Test::Unit::TestCase
+  include DSP
+  include TestHelper
+
+  class Port  # records what was written, and when
+    attr_reader :sent
+    def initialize; @sent = []; end
+    def write events
+      events.each{ |e| @sent << [e[:message], Process.clock_gettime( Process::CLOCK_MONOTONIC )] }
+    end
+  end
+
+  def setup
+    super
+    @port  = Port.new
+    @clock = MIDI::Clock.new( Dc.new( 0.0 ), :port => @port, :bpm => 125 )  # a pulse every 20 samples
+  end
+
+  def teardown
+    @clock.close
+    super
+  end
+
+  def test_pulses_start_stop_and_notes_in_order
+    @clock.start( 0.010 )
+    @clock.note_out @clock.beat_time( 0.125 ), 60, 100, 0.050, 2  # samples 70 and 120
+    @clock.stop( 0.200 )
+    @clock.ticks( 256 )
+    assert_equal 10, @clock.pulses  # samples 10, 30, ... 190
+    @clock.close
+    assert_equal [0xfa] + [0xf8] * 3 + [0x92] + [0xf8] * 3 + [0x82] + [0xf8] * 4 + [0xfc], @port.sent.map{ |m,_| m[0] }
+    assert_equal [0x82, 60, 0], @port.sent[8][0]
+  end
+
+  def test_messages_go_out_on_the_sample_clock
+    @clock.start
+    @clock.stop( 0.2 )
+    @clock.ticks( 200 )  # renders instantly; the sender spreads them over 0.2s
+    @clock.close
+    times = @port.sent.select{ |m,_| m[0] == 0xf8 }.map( &:last )
+    gaps  = times.each_cons( 2 ).map{ |a,b| b - a }
+    assert_equal 9, gaps.size
+    assert_in_delta 0.020, gaps.sort[gaps.size / 2], 0.002  # median: one late wakeup on a busy box is fine
+    assert_in_delta 0.180, times.last - times.first, 0.030
+  end
+
+  def test_sender_blocks_when_idle_and_close_unregisters
+    sleep 0.01 until @clock.instance_variable_get( :@sender ).status == "sleep"
+    live = MIDI::Clock.class_variable_get( :@@live )
+    assert_include live, @clock
+    @clock.close
+    assert_not_include live, @clock
+  end
+
+  def test_output_without_driver_support
+    MIDI.define_singleton_method( :portmidi ){ Module.new }  # a gem with input only
+    error = assert_raise( NotImplementedError ){ MIDI.output }
+    assert_match(/no output support/, error.message)
+  ensure
+    MIDI.singleton_class.send( :remove_method, :portmidi )
+  end
+
+  def test_tempo_and_beats
+    assert_in_delta 0.48, @clock.beat_time( 1 ), 1e-12
+    @clock.bpm = 60
+    assert_in_delta 1.0, @clock.beat_time( 1 ), 1e-12
+    fired = nil
+    @clock.at_beat( 0.01 ){ fired = @clock.pos }
+    @clock.ticks( 20 )
+    assert_equal 10, fired
+  end
+end
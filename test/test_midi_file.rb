@@ -0,0 +1,139 @@
+require_relative "helper"
+require "tmpdir"
+
+class TestMidiFile < Test::Unit::TestCase
+  include DSP
+  include TestHelper
+
+  def setup
+    super
+    @dir = Dir.mktmpdir
+  end
+
+  def teardown
+    FileUtils.rm_rf( @dir )
+    super
+  end
+
+  def varlen n
+    bytes = [n & 0x7f]
+    bytes.unshift( (n >>= 7) & 0x7f | 0x80 ) while n > 0x7f
+    bytes.pack( "C*" )
+  end
+
+  def track events  # [delta, bytes...]
+    body = events.map{ |delta, *bytes| varlen( delta ) + bytes.pack( "C*" ) }.join + "\x00\xff\x2f\x00".b
+    "MTrk" + [body.bytesize].pack( "N" ) + body
+  end
+
+  # format 1, 100 ticks a quarter: a tempo track going 120 -> 60bpm after
+  # one quarter, and a note track using running status and velocity 0 offs
+  def song
+    tempo = track( [[0, 0xff, 0x51, 3, 0x07, 0xa1, 0x20], [100, 0xff, 0x51, 3, 0x0f, 0x42, 0x40]] )
+    notes = track( [[0, 0x90, 60, 100], [0, 64, 80], [50, 0x80, 60, 0], [150, 0x90, 64, 0],
+                    [0, 0xc1, 5], [0, 0xf0, 2, 1, 0xf7], [0, 0x91, 67, 127], [100, 0x81, 67, 0]] )
+    "MThd" + [6, 1, 2, 100].pack( "Nn3" ) + "XTRA\x00\x00\x00\x01z".b + tempo + notes
+  end
+
+  def test_parses_notes_through_the_tempo_map
+    smf = MIDI::SMF.new( song )
+    assert_equal [1, 2, 100], [smf.format, smf.track_count, smf.division]
+    got = smf.notes.map{ |e| [e.time.round( 9 ), e.kind, e.note, e.velocity, e.channel] }
+    assert_equal [[0.0, :on, 60, 100, 0], [0.0, :on, 64, 80, 0], [0.25, :off, 60, 0, 0],
+                  [1.5, :off, 64, 0, 0], [1.5, :on, 67, 127, 1], [2.5, :off, 67, 0, 1]], got
+    assert_equal 2.5, smf.duration
+  end
+
+  def test_rejects_bad_files
+    assert_raise( MIDI::SMF::FormatError ){ MIDI::SMF.new( "RIFF0000WAVE" ) }
+    assert_raise( MIDI::SMF::FormatError ){ MIDI::SMF.new( song[0, 40] ) }
+  end
+
+  def test_rejects_divisions_with_no_ticks
+    notes = track( [[0, 0x90, 60, 100], [100, 60, 0]] )
+    [0, 0xe700, 0x8000].each do |division|  # none a quarter; 25fps with 0 ticks a frame; 0x80 frames wraps to 128, 0 ticks
+      error = assert_raise( MIDI::SMF::FormatError ){ MIDI::SMF.new( "MThd" + [6, 0, 1, division].pack( "Nn3" ) + notes ) }
+      assert_match( /division/, error.message )
+    end
+    smf = MIDI::SMF.new( "MThd" + [6, 0, 1, 0xe728].pack( "Nn3" ) + notes )  # 25fps, 40 ticks a frame
+    assert_equal [0.0, 0.1], smf.notes.map( &:time )
+  end
+
+  def test_meta_and_sysex_cancel_running_status
+    meta  = track( [[0, 0x90, 60, 100], [0, 0xff, 0x01, 1, 0x41], [10, 64, 80]] )  # text event, then a bare data byte
+    sysex = track( [[0, 0x90, 60, 100], [0, 0xf0, 1, 0xf7], [10, 64, 80]] )
+    [meta, sysex].each do |t|
+      error = assert_raise( MIDI::SMF::FormatError ){ MIDI::SMF.new( "MThd" + [6, 0, 1, 100].pack( "Nn3" ) + t ) }
+      assert_match( /running status/, error.message )
+    end
+  end
+
+  def test_longer_header_is_skipped
+    notes = track( [[0, 0x90, 60, 100], [100, 60, 0]] )
+    smf = MIDI::SMF.new( "MThd" + [8, 0, 1, 100, 0x7f7f].pack( "Nn4" ) + notes )
+    assert_equal [[0.0, :on], [0.5, :off]], smf.notes.map{ |e| [e.time, e.kind] }
+    assert_raise( MIDI::SMF::FormatError ){ MIDI::SMF.new( "MThd" + [4, 0, 1].pack( "Nn2" ) + notes ) }
+  end
+
+  def test_poly_keys_voices_by_channel_and_note
+    poly = Poly.new( 3, [0.0, 0.0, 1.0, 0.0] ){ Dc.new }
+    poly.note_on 60, 127, 0
+    poly.note_on 60, 127, 9
+    assert_equal 2, poly.active
+    poly.note_off 60, 9
+    poly.ticks( 1 )
+    assert_equal 1, poly.active
+    poly.note_on 60, 127, 0  # retrigger takes the voice already on it
+    assert_equal 1, poly.active
+
+    seq = Sequencer.new( poly )
+    seq.note( 0.0, 60, 127, nil, 9 )
+    seq.note_off( 0.002, 60, 9 )
+    seq.ticks( 4 )
+    assert_equal 1, poly.active  # channel 0 still sounding
+  end
+
+  def test_poly_pools_and_steals_voices
+    poly = Poly.new( 2, [0.0, 0.0, 1.0, 0.0] ){ Dc.new }
+    poly.note_on 60, 127
+    poly.note_on 64, 127
+    assert_equal [2.0] * 4, poly.ticks( 4 ).to_a
+    poly.note_on 67, 127   # steals the voice on 60
+    poly.note_off 60       # so this does nothing
+    assert_equal 2, poly.active
+    assert_in_delta MIDI::note_to_freq( 67 ), poly.voices[0].freq, 1e-9
+    poly.all_notes_off
+    poly.ticks( 4 )
+    assert_equal 0, poly.active
+    assert_equal [0.0] * 4, poly.ticks( 4 ).to_a
+  end
+
+  def test_render_and_run_all
+    File.binwrite( mid = File.join( @dir, "song.mid" ), song )
+    bounce = MidiRender.new( :voices => 4, :adsr => [0.0, 0.0, 1.0, 0.0], :gain => 0.5, :tail => 0.1 ){ Dc.new }
+    result = bounce.run( mid, out = File.join( @dir, "song.wav" ) )
+    assert_equal 2600, result.frames
+    samples = RiffFile.new( out, "r" ){ |wav| break wav.simple_read }
+    runs = samples.chunk{ |v| v }.map{ |v,run| [v, run.size] }
+    [[180 / 254.0, 250], [80 / 254.0, 1250], [0.5, 1000], [0.0, 100]].zip( runs ).each do |(level, size), (v, n)|
+      assert_in_delta level, v, 1e-6  # velocity scaled, float32
+      assert_equal size, n
+    end
+    File.binwrite( File.join( @dir, "bad.mid" ), "nope" )
+    File.binwrite( again = File.join( @dir, "again.mid" ), song )
+    results = bounce.run_all( [mid, File.join( @dir, "bad.mid" ), again], File.join( @dir, "out" ), :workers => 2 )
+    assert_equal [2600, 2600], results.map( &:frames )
+  end
+
+  def test_failed_render_closes_its_output
+    File.binwrite( mid = File.join( @dir, "song.mid" ), song )
+    calls = 0
+    bounce = MidiRender.new( :block => 100 ) do
+      Dc.new.tap{ |v| v.define_singleton_method( :tick ){ raise "broken voice" if (calls += 1) > 500; 1.0 } }
+    end
+    out = File.join( @dir, "song.wav" )
+    assert_raise( RuntimeError ){ bounce.run( mid, out ) }
+    assert ObjectSpace.each_object( File ).none?{ |f| !f.closed? && f.path == out }
+    assert_equal 1, RiffFile.probe( out ).channels  # sizes patched
+  end
+end
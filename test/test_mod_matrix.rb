@@ -0,0 +1,57 @@
+require_relative "helper"
+
+class TestModMatrix < Test::Unit::TestCase
+  include DSP
+  include TestHelper
+
+  class Counter < Generator  # counts the samples it was asked for
+    attr_reader :rendered
+    def initialize; @rendered = 0; end
+    def tick; @rendered += 1; 1.0; end
+  end
+
+  def test_block_rate_route_with_depth_and_curve
+    saw = SuperSaw.new( 100.0 )
+    mm  = ModMatrix.new( saw, 16 )
+    mm.route Dc.new( 1.0 ), "spread", :depth => -0.25
+    mm.route Dc.new( 0.5 ), "freq", :curve => :exp  # half an octave up
+    mm.ticks( 32 )
+    assert_in_delta 0.25, saw.spread, 1e-12
+    assert_in_delta 100.0 * 2 ** 0.5, saw.freq, 1e-9
+    mm["spread"] = 0.75
+    mm.ticks( 16 )
+    assert_in_delta 0.5, saw.spread, 1e-12
+    mm.unroute "spread"
+    assert_in_delta 0.75, saw.spread, 1e-12
+    assert_raise( ArgumentError ){ mm.route Dc.new( 1.0 ), "nope" }
+  end
+
+  def test_sources_render_once_per_block_however_many_routes
+    src = Counter.new
+    mm  = ModMatrix.new( XFader[ SuperSaw.new, SuperSaw.new ], 64 )
+    %w[a.spread a.mix b.spread b.mix].each{ |path| mm.route src, path, :depth => 0.1 }
+    mm.ticks( 256 )
+    assert_equal 256, src.rendered
+  end
+
+  def test_lfo_sources_step_once_per_period
+    lfo = LFO.new( 1.0, :saw )
+    saw = SuperSaw.new
+    mm  = ModMatrix.new( saw, 250 )
+    mm.route lfo, "mix", :depth => 0.5
+    mm.ticks( 500 )  # two periods: the value at the start of the second
+    assert_in_delta 0.75 + 0.5 * -0.5, saw.mix, 1e-12
+    assert_in_delta 0.5, lfo.phase, 1e-12
+  end
+
+  def test_audio_rate_destination_gets_a_buffer
+    fader = XFader.new( Dc.new( 0.0 ), Dc.new( 1.0 ), 0.0 )
+    mm = ModMatrix.new( fader, 8 )
+    env = Envelope.new( [[1.0, 0.008, Envelope::LINEAR]] )
+    env.trigger
+    mm.route env, "fade"
+    out = mm.ticks( 8 ).to_a
+    assert_equal (1..8).map{ |i| i / 8.0 }, out.map{ |v| v.round( 12 ) }
+    assert_equal 1.0, fader.fade
+  end
+end
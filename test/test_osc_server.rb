@@ -0,0 +1,82 @@
+require "test/unit"
+require "stringio"
+require "radspberry/core"
+
+class TestOscServer < Test::Unit::TestCase
+  include DSP
+
+  class Level < Generator
+    param_accessor :level, :default => 0.0
+    def tick
+      level
+    end
+  end
+
+  def osc_string s
+    s = s + "\0"
+    s + "\0" * (-s.bytesize % 4)
+  end
+
+  def message address, value
+    osc_string( address ) + osc_string( ",f" ) + [value].pack( "g" )
+  end
+
+  def bundle time, *messages
+    osc_string( "#bundle" ) + [time >> 32, time & 0xFFFFFFFF].pack( "NN" ) +
+      messages.map{ |m| [m.bytesize].pack( "N" ) + m }.join
+  end
+
+  def setup
+    @server = OscServer.new( XFader[ Level.new, Level.new ], 0 )
+  end
+
+  def teardown
+    @server.close
+  end
+
+  def test_parse_bundle
+    got = []
+    OscServer.parse( bundle( 42, message( "/a/level", 0.5 ), message( "/fade", 1.0 ) ) ){ |*m| got << m }
+    assert_equal [["/a/level", 0.5, 42], ["/fade", 1.0, 42]], got
+  end
+
+  def test_truncated_arguments_are_rejected
+    [ osc_string( "/a" ) + osc_string( ",b" ),
+      osc_string( "/a" ) + osc_string( ",fb" ) + [0.5].pack( "g" ),
+      osc_string( "/a" ) + osc_string( ",fi" ),
+      osc_string( "/a" ) + osc_string( ",b" ) + [8].pack( "N" ) + "abcd",  # blob longer than what's left
+      osc_string( "#bundle" ) + "\0\0" ].each do |packet|
+      assert_raise( ArgumentError, packet.inspect ){ OscServer.parse( packet ){} }
+    end
+  end
+
+  def test_bad_packets_dont_stop_the_receiver
+    io = Log.io
+    Log.io = StringIO.new
+    socket = UDPSocket.new
+    socket.send( osc_string( "/a" ) + osc_string( ",fi" ), 0, "127.0.0.1", @server.port )
+    socket.send( message( "/nope", 1.0 ), 0, "127.0.0.1", @server.port )
+    100.times{ break if @server.unknown > 0; sleep 0.01 }
+    assert_equal 1, @server.unknown
+    assert_equal 2, @server.received
+  ensure
+    Log.io = io
+  end
+
+  def test_scheduled_changes_split_the_block
+    @server.fade = 0.0
+    @server.schedule "/a/level", 1.0, 3
+    @server.schedule "/*/level", 0.5, 6  # a pattern hits both inputs
+    assert_equal [0, 0, 0, 1, 1, 1, 0.5, 0.5], @server.ticks( 8 ).to_a
+    assert_equal 8, @server.clock
+  end
+
+  def test_udp_messages_reach_the_graph
+    UDPSocket.new.send( bundle( OscServer::IMMEDIATE, message( "/b/level", 0.25 ), message( "/nope", 1.0 ) ),
+                        0, "127.0.0.1", @server.port )
+    100.times{ break if @server.unknown > 0; sleep 0.01 }
+    @server.fade = 1.0
+    assert_equal [0.25] * 4, @server.ticks( 4 ).to_a
+    assert_equal 1, @server.unknown
+  end
+end
@@ -0,0 +1,78 @@
+require "test/unit"
+require "radspberry/core"
+
+class TestParamBlock < Test::Unit::TestCase
+  include DSP
+
+  def setup
+    @name = "test-#{Process.pid}-params"
+  end
+
+  def test_map_follows_nested_inputs_once
+    saw = SuperSaw.new
+    map = ParamMap.new( XFader[ XFader[ saw, RpmNoise.new ], saw ] )  # saw is reached twice
+    assert_equal %w[fade a.fade a.a.freq a.a.spread a.a.mix a.b.freq a.b.phase], map.paths
+    map["a.a.spread"].set 0.2
+    assert_equal 0.2, saw.spread
+    assert_equal saw, map["a.a.mix"].target
+  end
+
+  def test_map_unknown_paths_and_hand_added_params
+    map = ParamMap.new( SuperSaw.new )
+    assert_nil map["nope"]
+    assert_nil map["spread.nope"]
+    gen = Struct.new( :gain ).new( 1.0 )
+    map.add "out.gain", gen, :gain, 0..2
+    map["out.gain"].set 0.5
+    assert_equal 0.5, gen.gain
+    assert_equal 4, map.size
+  end
+
+  def test_map_ranges_clamp_through_the_accessors
+    saw = SuperSaw.new
+    map = ParamMap.new( saw )
+    assert_equal 0..1, map["spread"].range
+    assert_nil map["freq"].range  # declared :range => false
+    map["spread"].set 2.0
+    assert_equal 1.0, saw.spread
+    map["spread"].set( -1 )
+    assert_equal 0.0, saw.spread
+  end
+
+  def test_client_sees_paths_and_ranges
+    saw = SuperSaw.new
+    block = ParamBlock.new( saw, @name )
+    client = ParamBlock.connect( @name )
+    assert_equal %w[freq spread mix], client.paths
+    assert_equal 0.0..1.0, client.range( "spread" )
+    assert_equal( -Float::INFINITY..Float::INFINITY, client.range( "freq" ) )
+    assert_equal 0.5, client["spread"]
+    assert_raise( KeyError ){ client["nope"] }
+    assert_raise( KeyError ){ client.update "mix" => 0.1, "nope" => 1.0 }
+    client["spread"] = 0.3  # still applied after the failed update
+    block.ticks( 16 )
+    assert_equal 0.3, saw.spread
+    assert_equal 0.75, saw.mix
+  ensure
+    client.close if client
+    block.unlink if block
+  end
+
+  def test_param_block_applies_external_writes_once_per_block
+    saw = SuperSaw.new
+    block = ParamBlock.new( saw, @name )
+    assert_equal %w[freq spread mix], block.map.paths
+
+    pid = fork do
+      ParamBlock.connect( @name ).update "spread" => 0.1, "freq" => 110.0
+      exit!(0)
+    end
+    Process.wait( pid )
+    assert_equal 0.5, saw.spread
+    block.ticks( 16 )
+    assert_equal 0.1, saw.spread
+    assert_equal 110.0, block.freq  # delegated to the synth
+  ensure
+    block.unlink if block
+  end
+end
@@ -0,0 +1,55 @@
+require "test/unit"
+require "radspberry/core"
+
+class TestPcmSink < Test::Unit::TestCase
+  include DSP
+
+  class Steps < Generator
+    VALUES = [0.5, -0.25, 1.5, -2.0, 0.1, 0.0]
+
+    def initialize
+      @i = -1
+    end
+
+    def tick
+      VALUES[ (@i += 1) % VALUES.size ]
+    end
+  end
+
+  def render format
+    reader, writer = IO.pipe
+    sink = PcmSink.new( Steps.new, writer, :format => format, :frameSize => 4 )  # blocks of 4 and 2
+    sink.run( Rational( 6, Base.sampleRate.to_i ) )
+    writer.close
+    [sink, reader.binmode.read]
+  ensure
+    reader.close
+  end
+
+  def test_float32
+    sink, bytes = render( :float32 )
+    assert_equal 6, sink.frames_written
+    assert_equal 24, sink.bytes_written
+    assert_equal Steps::VALUES.pack( "e*" ), bytes
+  end
+
+  def test_int16_scales_and_clips
+    sink, bytes = render( :int16 )
+    assert_equal 12, sink.bytes_written
+    assert_equal [16384, -8192, 32767, -32767, 3277, 0], bytes.unpack( "s<*" )
+    assert_equal "\x00\x40".b, bytes[0, 2]  # little endian
+  end
+
+  def test_stops_when_the_reader_goes_away
+    reader, writer = IO.pipe
+    reader.close
+    sink = PcmSink.new( Steps.new, writer, :format => :int16 ).run
+    assert_equal 0, sink.frames_written
+  ensure
+    writer.close
+  end
+
+  def test_rejects_unknown_formats
+    assert_raise( ArgumentError ){ PcmSink.new( Steps.new, $stdout, :format => :int24 ) }
+  end
+end
@@ -0,0 +1,58 @@
+require "test/unit"
+require "tmpdir"
+require "radspberry/core"
+
+class TestPeakFile < Test::Unit::TestCase
+
+  def setup
+    @dir = Dir.mktmpdir
+  end
+
+  def teardown
+    FileUtils.remove_entry @dir
+  end
+
+  def test_streamed_pyramid
+    path = File.join(@dir, "ramp.peaks")
+    peaks = PeakFile.new(path, 2, 44100, [4, 16])
+    samples = (0...40).flat_map { |i| [i / 40.0, -i / 40.0] }
+    samples.each_slice(7) { |block| peaks << block }  # blocks that split frames
+    peaks.finish
+
+    reader = PeakFile.open(path)
+    assert_equal 40, reader.frames
+    assert_equal [10, 3], reader.levels.map(&:bins)
+    fine = reader.bins(reader.levels[0], 1, 1)[0]
+    assert_in_delta 4 / 40.0, fine[0][0], 1e-6
+    assert_in_delta 7 / 40.0, fine[0][1], 1e-6
+    assert_in_delta(-7 / 40.0, fine[1][0], 1e-6)
+    coarse = reader.bins(reader.levels[1], 2, 5)  # clipped to the 8 frame tail
+    assert_equal 1, coarse.size
+    assert_in_delta 39 / 40.0, coarse[0][0][1], 1e-6
+    assert_in_delta Math.sqrt((32..39).inject(0.0) { |s, i| s + (i / 40.0)**2 } / 8), coarse[0][0][2], 1e-6
+
+    assert_equal reader.levels[1], reader.level_for(20)
+    view = reader.view(0, 40, 2)
+    assert_in_delta 0.0, view[0][0], 1e-6
+    assert_in_delta 39 / 40.0, view[1][1], 1e-6
+  end
+
+  def test_generate_from_wav
+    wav = File.join(@dir, "a.wav")
+    RiffFile.new(wav, "wb+") { |w| w.write(1, 44100, 16, [[16384, -8192] * 300]) }
+    PeakFile.spawn(wav).join
+    reader = PeakFile.open(PeakFile.sidecar(wav))
+    assert_equal 600, reader.frames
+    assert_equal [3, 1, 1], reader.levels.map(&:bins)
+    assert_in_delta 0.5, reader.view(0, 600, 1)[0][1], 1e-6
+  end
+
+  def test_open_relative_path
+    Dir.chdir(@dir) do
+      peaks = PeakFile.new("take1.wav.peaks", 1, 44100, [4])
+      peaks << [0.25] * 8
+      peaks.finish
+      assert_equal 8, PeakFile.open("take1.wav.peaks").frames
+    end
+  end
+end
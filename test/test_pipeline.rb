@@ -0,0 +1,80 @@
+require "test/unit"
+require "tmpdir"
+require "stringio"
+require "radspberry/core"
+
+class TestPipeline < Test::Unit::TestCase
+  include DSP
+
+  def setup
+    @dir = Dir.mktmpdir
+  end
+
+  def teardown
+    FileUtils.remove_entry @dir
+  end
+
+  def write_wav name, channels, samples, rate = 44100
+    path = File.join(@dir, name)
+    RiffFile.new(path, "wb+") { |wav| wav.write(channels, rate, 16, [samples]) }
+    path
+  end
+
+  def test_processor_chain_ticks_its_input
+    chain = ProcessorChain.new( [ZDLP.new( 1000 ), ZDLP.new( 1000 )], 2.0 )
+    a, b = ZDLP.new( 1000 ), ZDLP.new( 1000 )
+    expected = [1.0, 0.0, 0.0].map{ |x| 2.0 * b.tick( a.tick( x ) ) }
+    assert_equal expected, chain.ticks( [1.0, 0.0, 0.0] )
+  end
+
+  def test_stereo_file_matches_per_sample_processing_plus_tail
+    input = write_wav("in.wav", 2, Array.new(10000) { |i| i.even? ? 16384 : (i % 7) * 1000 })
+    pipeline = Pipeline.new(:block => 1000, :tail => 0.01) { ZDLP.new(500) }
+    result = pipeline.run(input, File.join(@dir, "out.wav"))
+    assert_equal 5000 + 441, result.frames
+
+    left, right = ZDLP.new(500), ZDLP.new(500)
+    RiffFile.new(result.output, "r") do |wav|
+      out = wav.simple_read
+      assert_equal 2 * (5000 + 441), out.size
+      assert_in_delta left.tick(0.5), out[0], 1e-6
+      assert_in_delta right.tick(1000 / 32768.0), out[1], 1e-6
+      assert_in_delta left.tick(0.5), out[2], 1e-6
+      assert_in_delta right.tick(3000 / 32768.0), out[3], 1e-6
+    end
+    assert_equal 44100.0, Base.sampleRate
+  end
+
+  def test_run_all_in_parallel
+    inputs = 3.times.map { |i| write_wav("in#{i}.wav", 1, [16384 * (i + 1) / 4] * 500) }
+    inputs << File.join(@dir, "missing.wav")
+    results = Pipeline.new(:format => :pcm16, :dither => false) { Hpf.new(20) }.run_all(inputs, File.join(@dir, "out"), :workers => 2)
+    assert_equal inputs.first(3), results.map(&:source)
+    assert_equal [500] * 3, results.map(&:frames)
+    assert_equal 3, Dir[File.join(@dir, "out", "*.wav")].size
+  end
+
+  def test_run_all_rejects_sources_with_the_same_output
+    FileUtils.mkdir_p([File.join(@dir, "a"), File.join(@dir, "b")])
+    inputs = [write_wav("a/take.wav", 1, [0] * 10), write_wav("b/take.wav", 1, [0] * 10), File.join(@dir, "take.flac")]
+    out = File.join(@dir, "out")
+    error = assert_raise(ArgumentError) { Pipeline.new { Hpf.new(20) }.run_all(inputs, out, :workers => 2) }
+    assert_match(%r{a/take.wav, .*b/take.wav, .*take.flac -> .*out/take.wav}, error.message)
+    assert !File.exist?(out)
+  end
+
+  def test_run_all_survives_graph_errors_and_dead_workers
+    io, DSP::Log.io = DSP::Log.io, StringIO.new
+    rates = [44100, 44100, 44100, 44100, 22050, 32000]
+    inputs = rates.each_with_index.map { |rate, i| write_wav("in#{i}.wav", 1, [1000] * 100, rate) }
+    pipeline = Pipeline.new do
+      exit!(1) if Base.sampleRate == 22050  # kills the worker holding in1 and in4
+      raise NoMethodError, "broken graph" if Base.sampleRate == 32000
+      Hpf.new(20)
+    end
+    results = pipeline.run_all(inputs, File.join(@dir, "out"), :workers => 3)
+    assert_equal inputs.values_at(0, 2, 3), results.map(&:source)
+  ensure
+    DSP::Log.io = io
+  end
+end
@@ -0,0 +1,49 @@
+require "test/unit"
+require "tmpdir"
+require "radspberry/core"
+
+class TestQuantizer < Test::Unit::TestCase
+  include DSP
+
+  def test_tpdf_dither_stays_within_one_lsb_and_is_unbiased
+    q = Quantizer.new( 16, :seed => 1 )
+    x = 0.3 / 32767  # a third of an lsb: truncation would always give 0
+    out = q.convert( [x] * 20000 )
+    assert_equal [-1, 0, 1], out.uniq.sort
+    assert_in_delta 0.3, out.inject(:+) / 20000.0, 0.02
+  end
+
+  def test_clips_and_counts
+    q = Quantizer.new( 16, :dither => false )
+    assert_equal [32767, -32768, 16384], q.convert( [1.5, -2.0, 0.5] ).map{ |v| v.round }
+    assert_equal 2, q.clipped
+  end
+
+  def test_noise_shaping_moves_error_up
+    x = Array.new( 4096 ){ |i| 0.25 * ::Math.sin( i * 0.01 ) }
+    low = [false, true].map do |shape|
+      err = Quantizer.new( 16, :shape => shape, :seed => 2 ).convert( x ).each_with_index.map{ |v,i| v - x[i] * 32767 }
+      err.each_cons( 16 ).map{ |w| (w.inject(:+) / 16).abs }.inject(:+)  # error left after a crude lowpass
+    end
+    assert_operator low[1], :<, 0.7 * low[0]
+  end
+
+  def test_24_bit_pack_roundtrip
+    q = Quantizer.new( 24, :dither => false )
+    bytes = q.pack( [0.5, -0.5, -1.0] )
+    assert_equal 9, bytes.bytesize
+    assert_equal [4194304, -4194304, -8388607], RiffFile.allocate.unpack_samples( bytes, 24 )
+  end
+
+  def test_to_wav_normalizes_through_the_quantizer
+    Dir.mktmpdir do |dir|
+      file = File.join( dir, "tone.wav" )
+      Phasor.new( 441 ).to_wav( 0.1, file, :bits => 24 )
+      RiffFile.new( file, "r" ) do |wav|
+        peak = wav.each_block.flat_map{ |b| b.map(&:abs) }.max / wav.full_scale.to_f
+        assert_in_delta 10 ** (-0.5 / 20), peak, 1e-5
+        assert_equal 4410, wav.total_samples
+      end
+    end
+  end
+end
@@ -0,0 +1,53 @@
+require "test/unit"
+require "tmpdir"
+require "rbconfig"
+require "radspberry"
+
+class TestRecorder < Test::Unit::TestCase
+  include DSP
+
+  def test_ring_buffer_drops_when_full
+    ring = RingBuffer.new(2)
+    assert ring.push(1)
+    assert ring.push(2)
+    assert_equal false, ring.push(3)
+    assert_equal 1, ring.dropped
+    assert_equal 1, ring.pop
+    assert ring.push(4)
+    assert_equal [2,4], [ring.pop, ring.pop]
+    assert_nil ring.pop
+  end
+
+  def test_records_blocks_to_valid_wav
+    Dir.mktmpdir do |dir|
+      file = File.join(dir, "take.wav")
+      rec  = Recorder.new( file, :format => :pcm16, :frameSize => 64, :flush_every => 1 )
+      10.times{ rec << Array.full_of( 0.5, 64 ) }
+      assert_include Recorder.class_variable_get( :@@live ), rec
+      rec.stop
+      assert_not_include Recorder.class_variable_get( :@@live ), rec
+      assert_equal 640, rec.frames_written
+      assert_equal 0, rec.dropped
+
+      RiffFile.new(file, 'r') do |wav|
+        assert_equal 16, wav.format.bit_depth
+        assert_equal 2,  wav.format.block_align
+        assert_equal 640, wav.total_samples
+        assert_in_delta 16384, wav.simple_read.first, 1  # tpdf dither: within an lsb
+      end
+    end
+  end
+
+  def test_recordings_still_running_at_exit_are_finished
+    Dir.mktmpdir do |dir|
+      script = 'require "radspberry/core"
+        2.times{ |i| r = DSP::Recorder.new( File.join( ARGV[0], "#{i}.wav" ), :frameSize => 8 ); r << [0.25] * 8 }
+        DSP::Recorder.new( File.join( ARGV[0], "stopped.wav" ) ).stop'
+      lib = File.expand_path( "../../lib", __FILE__ )
+      assert system( RbConfig.ruby, "-I", lib, "-e", script, dir )
+      %w[0 1].each do |i|
+        RiffFile.new( File.join( dir, "#{i}.wav" ), 'r' ){ |wav| assert_equal [0.25] * 8, wav.simple_read }
+      end
+    end
+  end
+end
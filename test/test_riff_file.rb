@@ -0,0 +1,116 @@
+require "test/unit"
+require "tmpdir"
+require "radspberry/core"
+
+class TestRiffFile < Test::Unit::TestCase
+
+  def setup
+    @dir = Dir.mktmpdir
+  end
+
+  def teardown
+    FileUtils.remove_entry @dir
+  end
+
+  # fmt, then bext and a large iXML chunk, then data
+  def write_wav_with_metadata path, samples
+    fmt  = WaveFmtChunk.new
+    fmt.audio_format, fmt.num_channels, fmt.bit_depth = 1, 1, 16
+    fmt.set_sample_rate(48000)
+    bext = ["radspberry test"].pack("a602")
+    ixml = "<BWFXML><NOTE>#{'x' * 8000}</NOTE></BWFXML>"
+    data = samples.pack("s*")
+    body = "WAVE" + ["fmt ", 16].pack("A4V") + fmt.pack_header_data +
+           ["bext", bext.size].pack("A4V") + bext +
+           ["iXML", ixml.size].pack("A4V") + ixml +
+           ["data", data.size].pack("A4V") + data
+    File.binwrite path, ["RIFF", body.size].pack("A4V") + body
+  end
+
+  def test_metadata_is_parsed_on_first_access
+    path = File.join(@dir, "meta.wav")
+    write_wav_with_metadata path, [1, -2, 3]
+    RiffFile.new(path, 'r') do |wav|
+      assert_equal %w[fmt bext iXML data], wav.found_chunks
+      assert_nil wav.instance_variable_get(:@bext_meta)
+      assert_nil wav.instance_variable_get(:@ixml_meta)
+      assert_equal "radspberry test", wav.bext_meta.description
+      assert_equal [1, -2, 3], wav.simple_read
+    end
+  end
+
+  def test_probe
+    path = File.join(@dir, "meta.wav")
+    write_wav_with_metadata path, [0] * 480
+    probe = RiffFile.probe(path)
+    assert_equal [1, 1, 48000, 16, 480], probe.to_a
+    assert_in_delta 0.01, probe.duration, 1e-9
+
+    File.binwrite File.join(@dir, "junk.wav"), "not a wav"
+    assert_nil RiffFile.probe(File.join(@dir, "junk.wav"))
+  end
+
+  def test_probe_rejects_malformed_fmt
+    path = File.join(@dir, "bad.wav")
+    write_wav_with_metadata path, [0] * 480
+    wav = File.binread(path)
+    fmt = wav.index("fmt ")
+
+    File.binwrite path, wav[0, fmt + 8 + 6]  # ends inside the fmt chunk
+    assert_nil RiffFile.probe(path)
+
+    zero_align = wav.dup
+    zero_align[fmt + 8 + 12, 2] = [0].pack("v")
+    File.binwrite path, zero_align
+    assert_nil RiffFile.probe(path)
+
+    short = wav.dup
+    short[fmt + 4, 4] = [4].pack("V")  # too small to hold a format
+    File.binwrite path, short
+    assert_nil RiffFile.probe(path)
+  end
+
+  def test_extensible_multichannel_roundtrip
+    path = File.join(@dir, "surround.wav")
+    channels = (1..6).map { |c| [c * 1000, -c * 100_000] }
+    RiffFile.new(path, "wb+") { |wav| wav.write(6, 48000, 24, channels) }
+    RiffFile.new(path, 'r') do |wav|
+      assert wav.format.extensible?
+      assert_equal 0x3F, wav.format.channel_mask
+      assert_equal RiffFile::FORMAT_PCM, wav.format.sample_format
+      assert_equal channels.transpose.flatten, wav.simple_read
+    end
+  end
+
+  def test_extension_needs_a_full_cb_size
+    fmt = WaveFmtChunk.new
+    fmt.audio_format, fmt.num_channels, fmt.bit_depth = RiffFile::FORMAT_PCM, 2, 16
+    fmt.set_sample_rate(44100)
+    fmt.make_extensible
+    data = fmt.pack_header_data
+    assert_equal RiffFile::FORMAT_PCM, WaveFmtChunk.new(data).sample_format
+    data[16, 2] = [0].pack("v")
+    short = WaveFmtChunk.new(data)
+    assert_nil short.sub_format
+    assert_nil short.channel_mask
+  end
+
+  def test_streaming_writer_upgrades_to_rf64
+    path = File.join(@dir, "long.wav")
+    RiffFile.new(path, "wb+") do |wav|
+      wav.riff_limit = 1000
+      wav.begin_data(2, 44100, 32, RiffFile::FORMAT_FLOAT)
+      10.times { wav.append_data(wav.pack_samples([0.25] * 200, 32, RiffFile::FORMAT_FLOAT)) }
+      wav.finish_data
+      assert wav.rf64?
+    end
+    assert_equal ["RF64", 0xFFFFFFFF, "WAVE"], File.binread(path, 12).unpack("A4VA4")
+    RiffFile.new(path, 'r') do |wav|
+      assert_equal %w[ds64 fmt data], wav.found_chunks
+      assert_equal 1000, wav.total_samples
+      assert_equal [0.25] * 2000, wav.simple_read
+    end
+    assert_equal [RiffFile::FORMAT_FLOAT, 2, 44100, 32, 1000], RiffFile.probe(path).to_a
+  end
+
+end
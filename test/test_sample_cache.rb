@@ -0,0 +1,40 @@
+require "test/unit"
+require "tmpdir"
+require "radspberry/core"
+
+class TestSampleCache < Test::Unit::TestCase
+
+  def setup
+    @dir = Dir.mktmpdir
+    @wav = File.join(@dir, "a.wav")
+    RiffFile.new(@wav, "wb+") { |wav| wav.write(2, 22050, 16, [[16384, -8192] * 100]) }
+    @cache = SampleCache.new(File.join(@dir, "cache"))
+  end
+
+  def teardown
+    FileUtils.remove_entry @dir
+  end
+
+  def test_workers_share_one_entry
+    pids = 3.times.map do
+      fork { exit!(@cache.fetch(@wav).read(0, 1) == [0.5, -0.25] ? 0 : 1) }
+    end
+    assert pids.all? { |pid| Process.wait2(pid)[1].success? }
+    assert_equal 1, Dir[File.join(@cache.dir, "*.f32")].size
+    sample = @cache.fetch(@wav)
+    assert sample.instance_variable_get(:@mem).readonly?
+    assert_equal [2, 100, 22050.0], [sample.channels, sample.frames, sample.sample_rate]
+    assert_equal [0.5, -0.25] * 100, sample.to_a
+  end
+
+  def test_resampled_entry_and_prune
+    up = @cache.fetch(@wav, 44100)
+    assert_equal 44100.0, up.sample_rate
+    assert_equal 198, up.frames  # the last source frame has nothing to interpolate towards
+    assert_equal [0.5, -0.25] * 2, up.read(10, 2)
+    @cache.fetch(@wav)
+    assert_equal 2, Dir[File.join(@cache.dir, "*.f32")].size
+    File.utime(Time.now, Time.now + 10, @wav)
+    assert_equal 2, @cache.prune
+  end
+end
@@ -0,0 +1,56 @@
+require "test/unit"
+require "tmpdir"
+require "stringio"
+require "radspberry/core"
+
+class TestSampleIndex < Test::Unit::TestCase
+
+  def setup
+    @dir = Dir.mktmpdir
+    @lib = File.join(@dir, "lib")
+    Dir.mkdir(@lib)
+  end
+
+  def teardown
+    FileUtils.remove_entry @dir
+  end
+
+  def write_wav name, samples
+    RiffFile.new(File.join(@lib, name), "wb+") { |wav| wav.write(1, 44100, 16, [samples]) }
+  end
+
+  def test_incremental_scan
+    write_wav "a.wav", [16384, -8192] * 50
+    write_wav "b.wav", [0] * 441
+    index = SampleIndex.new(File.join(@dir, "samples.idx"), :workers => 2)
+    assert_equal({ :files => 2, :analyzed => 2, :removed => 0 }, index.scan(@lib))
+
+    a = index[File.join(@lib, "a.wav")]
+    assert_equal 100, a.frames
+    assert_in_delta 0.5, a.peak, 1e-9
+    assert_in_delta Math.sqrt((0.25 + 0.0625) / 2), a.rms, 1e-9
+
+    reloaded = SampleIndex.new(File.join(@dir, "samples.idx"))
+    assert_equal 2, reloaded.size
+    assert_in_delta 0.01, reloaded[File.join(@lib, "b.wav")].duration, 1e-9
+
+    File.delete File.join(@lib, "b.wav")
+    write_wav "c.wav", [1] * 10
+    assert_equal({ :files => 2, :analyzed => 1, :removed => 1 }, reloaded.scan(@lib))
+  end
+
+  def test_malformed_files_are_skipped_by_forked_workers
+    io, DSP::Log.io = DSP::Log.io, StringIO.new
+    write_wav "good.wav", [8192] * 20
+    write_wav "zero_align.wav", [8192] * 20
+    path = File.join(@lib, "zero_align.wav")
+    File.open(path, "r+b") { |f| f.seek(File.binread(path).index("fmt ") + 20); f.write([0].pack("v")) }  # block_align
+    File.binwrite(File.join(@lib, "junk.wav"), "RIFF" + "\xff" * 40)
+    index = SampleIndex.new(File.join(@dir, "samples.idx"), :workers => 3)
+    assert_equal 3, index.scan(@lib)[:files]
+    assert_equal [File.join(@lib, "good.wav")], index.map(&:path)
+  ensure
+    DSP::Log.io = io
+  end
+
+end
@@ -0,0 +1,67 @@
+require_relative "helper"
+
+class TestSequencer < Test::Unit::TestCase
+  include DSP
+  include TestHelper
+
+  def test_events_land_on_their_sample
+    dc  = Dc.new( 0.0 )
+    seq = Sequencer.new( dc )
+    seq.at( 0.013 ){ |s| s.level = 1.0 }
+    seq.at( 0.013 ){ |s| s.level = 2.0 }  # same time: in order
+    seq.at( 0.070 ){ |s| s.level = 3.0 }
+    out = seq.ticks( 50 ).to_a + seq.ticks( 50 ).to_a
+    assert_equal [0.0] * 13 + [2.0] * 57 + [3.0] * 30, out
+    assert_equal 0, seq.pending
+    assert_in_delta 0.1, seq.position, 1e-12
+  end
+
+  def test_negative_times_are_due_at_once_in_order
+    seq   = Sequencer.new( Dc.new )
+    fired = []
+    seq.at( 0.002 ){ fired << :later }
+    seq.at( 0.0 ){ fired << :now }
+    seq.at( -1.0 ){ fired << :past }
+    seq.at( -0.5 ){ fired << :past_too }
+    seq.ticks( 5 )
+    assert_equal [:now, :past, :past_too, :later], fired
+  end
+
+  def test_clear_drops_pending_events
+    seq = Sequencer.new( Dc.new, :capacity => 4 )
+    3.times{ |i| seq.swap( i / 1000.0, Dc.new ) }
+    seq.clear
+    assert_equal 0, seq.pending
+    assert_equal [nil] * 4, seq.instance_variable_get( :@events )
+  end
+
+  def test_heap_orders_many_events
+    seq   = Sequencer.new( Dc.new, :capacity => 4 )
+    fired = []
+    times = Array.new( 5000 ){ |i| (i * 7919) % 5000 }
+    times.each{ |t| seq.at( t / 1000.0 ){ fired << t } }
+    assert_equal 5000, seq.pending
+    seq.ticks( 2500 )
+    seq.ticks( 2500 )
+    assert_equal (0...5000).to_a, fired
+  end
+
+  def test_notes_set_and_swap
+    vca = VCA.new( Dc.new, Envelope.new( [[1.0, 0.0], [0.0, 0.0]], 0 ) )  # instant gate
+    seq = Sequencer.new( vca )
+    seq.note( 0.010, 69, 127, 0.010 )
+    seq.set( 0.005, "level", 0.5 )
+    out = seq.ticks( 30 ).to_a
+    assert_equal [0.0] * 10 + [0.5] * 10 + [0.0] * 10, out
+    assert_in_delta MIDI::A, vca.freq, 1e-9
+    seq.swap( 0.030, Dc.new( 0.25 ) )
+    assert_equal [0.25] * 5, seq.ticks( 5 ).to_a
+  end
+
+  def test_other_threads_go_through_the_inbox
+    seq = Sequencer.new( Dc.new( 0.0 ) )
+    seq.ticks( 10 )
+    Thread.new{ seq.at( 0.015 ){ |s| s.level = 1.0 } }.join
+    assert_equal [0.0] * 5 + [1.0] * 5, seq.ticks( 10 ).to_a
+  end
+end
@@ -0,0 +1,65 @@
+require "test/unit"
+require "stringio"
+require "radspberry/core"
+
+class TestShmRing < Test::Unit::TestCase
+  include DSP
+
+  def setup
+    @name = "test-#{Process.pid}"
+    @writer = ShmRing.create( @name, :slots => 4, :frames => 8 )
+  end
+
+  def teardown
+    @writer.close
+    @writer.unlink
+  end
+
+  def test_reader_sees_blocks_from_another_process
+    reader = ShmRing.open( @name )
+    pid = fork do
+      @writer << Array.full_of( 0.25, 12 )
+      exit!(0)
+    end
+    Process.wait( pid )
+    assert_equal [0.25] * 8, reader.read
+    assert_equal [0.25] * 4, reader.read
+    assert_nil reader.read
+  end
+
+  def test_overrun_and_source_underrun
+    source = ShmSource.new( @name )
+    6.times{ |i| @writer << Array.full_of( i.to_f, 8 ) }
+    assert_equal [2.0] * 8, source.ticks(8).to_a
+    assert_equal 2, source.overruns
+    source.ticks(24)
+    assert_equal 0, source.underruns
+    assert_equal [0.0] * 8, source.ticks(8).to_a
+    assert_equal 1, source.underruns
+  end
+
+  def test_open_checks_version_and_channels
+    mem = SharedMemory.new( @name )
+    mem.write( 8, [2].pack( "V" ) )
+    assert_raise( ArgumentError ){ ShmRing.open( @name ) }
+    mem.write( 8, [1].pack( "V" ) )
+    mem.write( 20, [2].pack( "V" ) )
+    assert_raise( ArgumentError ){ ShmRing.open( @name ) }
+  ensure
+    mem.close if mem
+  end
+
+  def test_source_warns_about_another_sample_rate
+    io, Log.io = Log.io, StringIO.new
+    other = ShmRing.create( "#{@name}-22k", :srate => 22050 )
+    ShmSource.new( "#{@name}-22k" )
+    Log.flush
+    assert_match( /runs at 22050 Hz but the sample rate is #{Base.sampleRate.round} Hz/, Log.io.string )
+  ensure
+    if other
+      other.close
+      other.unlink
+    end
+    Log.io = io
+  end
+end
@@ -0,0 +1,83 @@
+require_relative "helper"
+require "tmpdir"
+require "radspberry"
+
+class TestVirtualTime < Test::Unit::TestCase
+  include DSP
+  include TestHelper
+
+  def setup
+    super
+    @dir = Dir.mktmpdir
+  end
+
+  def teardown
+    FileUtils.rm_rf( @dir )
+    super
+  end
+
+  def samples path
+    RiffFile.new( path, "r" ){ |wav| return wav.simple_read }
+  end
+
+  def test_sleep_renders_and_changes_land_on_the_clock
+    out = File.join( @dir, "take.wav" )
+    t = Time.now
+    result = VirtualTime.render( out ) do
+      Speaker[ Dc.new( 0.5 ) ]
+      sleep 0.0105
+      Speaker.synth.level = 0.25
+      sleep 0.0105           # 21 samples in all, no drift from rounding
+      Speaker.mute
+      sleep 0.003
+      Speaker.unmute
+      Speaker[ :volume => 2.0 ]
+      sleep 0.002
+    end
+    assert_operator Time.now - t, :<, 0.5
+    assert_equal 26, result.frames
+    assert_equal [0.5] * 11 + [0.25] * 10 + [0.0] * 3 + [0.5] * 2, samples( out )
+  end
+
+  def test_speaker_and_sleep_are_put_back
+    autoload = DSP.autoload?( :Speaker )
+    VirtualTime.render( File.join( @dir, "x.wav" ) ){ Speaker[ Dc.new ]; sleep 0.001 }
+    assert_equal autoload, DSP.autoload?( :Speaker )
+    assert_equal [], singleton_class.private_instance_methods( false )
+    assert_equal Kernel, method( :sleep ).owner
+    t = Time.now
+    sleep 0.02  # real again
+    assert_operator Time.now - t, :>=, 0.02
+  end
+
+  def test_sleeping_forever_ends_the_script
+    reached = false
+    result = VirtualTime.render( File.join( @dir, "x.wav" ) ) do
+      Speaker[ Dc.new ]
+      sleep 0.004
+      sleep
+      reached = true
+    end
+    assert_equal 4, result.frames
+    assert !reached
+  end
+
+  def test_render_script
+    script = File.join( @dir, "script.rb" )
+    File.write( script, <<-RUBY )
+      include DSP
+      def rest_a_while; sleep 0.005; end  # sleep from a method still renders
+      Speaker[ TestHelper::Dc.new( 1.0 ) ]
+      Speaker.record "#{@dir}/tail.wav"
+      rest_a_while
+      Speaker.stop_recording
+      sleep 0.005
+      sleep
+    RUBY
+    out = File.join( @dir, "script.wav" )
+    VirtualTime.render_script( script, out, :format => :pcm16 )
+    assert_equal 10, samples( out ).size
+    assert_equal 5, samples( File.join( @dir, "tail.wav" ) ).size
+    assert_equal Kernel, TOPLEVEL_BINDING.receiver.method( :sleep ).owner
+  end
+end